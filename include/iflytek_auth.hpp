@@ -0,0 +1,274 @@
+/**
+ * @Copyright: https://www.xfyun.cn/
+ * @Author: iflytek
+ * @Data: 2019-12-20
+ *
+ * 本文件包含“讯飞开放平台”的WebAPI接口鉴权url生成类定义及实现
+ * iflytek_authorizer适用于以hmac-sha256签名的v2接口（语音听写、语音合成、性别年龄识别等），鉴权流程为：
+ * 1. 生成RFC1123格式的时间戳date
+ * 2. 以APISecret对"host: $host\ndate: $date\nGET $path HTTP/1.1"进行hmac-sha256签名，base64编码后得到signature
+ * 3. 拼接authorization的原始字符串并base64编码，与date、host一起构成查询参数，url编码后得到鉴权url
+ */
+
+#ifndef _IFLYTEK_AUTH_HPP
+#define _IFLYTEK_AUTH_HPP
+
+#include <cstdio>
+#include <ctime>
+#include <cstring>
+#include <string>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "iflytek_utils.hpp"
+
+/**
+ * @brief 鉴权url生成器
+ * 构造时按APISecret预先计算hmac的内外填充（ipad/opad）后的sha256摘要上下文，以及签名原始字符串的固定前缀，
+ * 生成url时只需将该上下文复制到线程的摘要上下文并计算随date变化的部分，鉴权url直接写入调用者提供的缓冲区
+ * 同一个对象可以被多个线程同时使用
+ *
+ * [public]
+ * @func iflytek_authorizer 构造函数
+ * @func ~iflytek_authorizer 析构函数，释放摘要上下文
+ * @func get_url_length 获得鉴权url的最大长度
+ * @func get_url 生成鉴权url，写入调用者提供的缓冲区
+ *
+ * [protected]
+ * @func get_date 获得RFC1123格式的时间戳，每个线程按秒缓存
+ * @func get_digest_context 获得线程复用的摘要上下文
+ * @member path 接口路径
+ * @member inner_state 吸收ipad及签名原始字符串固定前缀后的sha256摘要上下文
+ * @member outer_state 吸收opad后的sha256摘要上下文
+ * @member authorization_prefix authorization原始字符串中signature之前的固定部分
+ * @member url_prefix 鉴权url中authorization参数值之前的固定部分
+ * @member url_suffix 鉴权url中date参数值之后的固定部分，即url编码后的host参数
+ */
+class iflytek_authorizer
+{
+public:
+    iflytek_authorizer(const std::string &host, const std::string &path, const std::string &api_key, const std::string &api_secret);
+    ~iflytek_authorizer();
+    iflytek_authorizer(const iflytek_authorizer &) = delete;
+    iflytek_authorizer &operator=(const iflytek_authorizer &) = delete;
+    size_t get_url_length() const;
+    size_t get_url(char *url, size_t size, time_t now) const;
+    size_t get_url(char *url, size_t size) const;
+    std::string get_url() const;
+
+protected:
+    static size_t get_date(time_t now, const char **date, const char **encoded_date);
+    static EVP_MD_CTX *get_digest_context();
+
+private:
+    std::string path;
+    EVP_MD_CTX *inner_state, *outer_state;
+    std::string authorization_prefix;
+    std::string url_prefix, url_suffix;
+};
+
+/**
+ * @brief 构造函数
+ * 预先计算hmac的内外填充状态及鉴权url的固定部分
+ * @param host 服务器主机名，例如"iat-api.xfyun.cn"
+ * @param path 接口路径，例如"/v2/iat"
+ * @param api_key 控制台获取的APIKey
+ * @param api_secret 控制台获取的APISecret
+ */
+iflytek_authorizer::iflytek_authorizer(const std::string &host, const std::string &path, const std::string &api_key, const std::string &api_secret)
+    : path(path), inner_state(EVP_MD_CTX_new()), outer_state(EVP_MD_CTX_new())
+{
+    // hmac的密钥超过分组长度时先进行摘要
+    unsigned char key[SHA256_CBLOCK] = {0};
+    if (api_secret.size() > SHA256_CBLOCK)
+    {
+        SHA256((const unsigned char *)api_secret.data(), api_secret.size(), key);
+    }
+    else
+    {
+        memcpy(key, api_secret.data(), api_secret.size());
+    }
+
+    unsigned char ipad[SHA256_CBLOCK], opad[SHA256_CBLOCK];
+    for (int i = 0; i < SHA256_CBLOCK; i++)
+    {
+        ipad[i] = key[i] ^ 0x36;
+        opad[i] = key[i] ^ 0x5c;
+    }
+
+    std::string signature_prefix = "host: " + host + "\ndate: ";
+    if (this->inner_state == NULL || this->outer_state == NULL ||
+        EVP_DigestInit_ex(this->inner_state, EVP_sha256(), NULL) != 1 ||
+        EVP_DigestUpdate(this->inner_state, ipad, sizeof(ipad)) != 1 ||
+        EVP_DigestUpdate(this->inner_state, signature_prefix.data(), signature_prefix.size()) != 1 ||
+        EVP_DigestInit_ex(this->outer_state, EVP_sha256(), NULL) != 1 ||
+        EVP_DigestUpdate(this->outer_state, opad, sizeof(opad)) != 1)
+    {
+        fprintf(stderr, "[ERROR] iflytek_authorizer: failed to initialize hmac-sha256 digest\n");
+    }
+
+    this->authorization_prefix = "api_key=\"" + api_key + "\", algorithm=\"hmac-sha256\", headers=\"host date request-line\", signature=\"";
+
+    this->url_prefix = "wss://" + host + path + "?authorization=";
+    char *encoded_host = new char[host.size() * 3];
+    this->url_suffix = "&host=" + std::string(encoded_host, get_url_encode(host.data(), host.size(), encoded_host));
+    delete[] encoded_host;
+}
+
+/**
+ * @brief 析构函数
+ * 释放预先计算的摘要上下文
+ */
+iflytek_authorizer::~iflytek_authorizer()
+{
+    EVP_MD_CTX_free(this->inner_state);
+    EVP_MD_CTX_free(this->outer_state);
+}
+
+/**
+ * @brief 获得鉴权url的最大长度
+ * @return 鉴权url的最大长度，不含结尾的'\0'
+ */
+size_t iflytek_authorizer::get_url_length() const
+{
+    size_t authorization_length = this->authorization_prefix.size() + 44 + 1;
+    return this->url_prefix.size() + (authorization_length + 2) / 3 * 4 * 3 + 6 + 29 * 3 + this->url_suffix.size();
+}
+
+/**
+ * @brief 生成鉴权url，写入调用者提供的缓冲区
+ * @param url 鉴权url缓冲区，结果以'\0'结尾
+ * @param size 缓冲区长度，需大于get_url_length()
+ * @param now 生成date所用的时间
+ * @return 鉴权url的长度，缓冲区不足或签名失败时返回0
+ */
+size_t iflytek_authorizer::get_url(char *url, size_t size, time_t now) const
+{
+    if (size <= this->get_url_length())
+    {
+        return 0;
+    }
+
+    const char *date, *encoded_date;
+    size_t date_length = get_date(now, &date, &encoded_date);
+
+    // 使用hmac-sha256算法结合apiSecret对signature_origin签名，获得签名后的摘要signature_sha
+    unsigned char signature_sha[SHA256_DIGEST_LENGTH];
+    unsigned int signature_length;
+    EVP_MD_CTX *ctx = get_digest_context();
+    if (ctx == NULL ||
+        EVP_MD_CTX_copy_ex(ctx, this->inner_state) != 1 ||
+        EVP_DigestUpdate(ctx, date, date_length) != 1 ||
+        EVP_DigestUpdate(ctx, "\nGET ", 5) != 1 ||
+        EVP_DigestUpdate(ctx, this->path.data(), this->path.size()) != 1 ||
+        EVP_DigestUpdate(ctx, " HTTP/1.1", 9) != 1 ||
+        EVP_DigestFinal_ex(ctx, signature_sha, &signature_length) != 1 ||
+        EVP_MD_CTX_copy_ex(ctx, this->outer_state) != 1 ||
+        EVP_DigestUpdate(ctx, signature_sha, sizeof(signature_sha)) != 1 ||
+        EVP_DigestFinal_ex(ctx, signature_sha, &signature_length) != 1)
+    {
+        fprintf(stderr, "[ERROR] iflytek_authorizer: hmac-sha256 signature failed\n");
+        return 0;
+    }
+
+    // 拼接authorization的原始字符串，signature为signature_sha的base64编码
+    char authorization_origin[512];
+    size_t length = this->authorization_prefix.size();
+    if (length + 45 > sizeof(authorization_origin))
+    {
+        return 0;
+    }
+    memcpy(authorization_origin, this->authorization_prefix.data(), length);
+    length += get_base64_encode(signature_sha, sizeof(signature_sha), authorization_origin + length);
+    authorization_origin[length++] = '"';
+
+    // 再对authorization_origin进行base64编码获得最终的authorization参数
+    char authorization[(sizeof(authorization_origin) + 2) / 3 * 4];
+    size_t authorization_length = get_base64_encode((unsigned char *)authorization_origin, length, authorization);
+
+    // 对相关参数构成url，并进行url编码，生成最终鉴权url
+    char *p = url;
+    memcpy(p, this->url_prefix.data(), this->url_prefix.size());
+    p += this->url_prefix.size();
+    p += get_url_encode(authorization, authorization_length, p);
+    memcpy(p, "&date=", 6);
+    p += 6;
+    size_t encoded_date_length = strlen(encoded_date);
+    memcpy(p, encoded_date, encoded_date_length);
+    p += encoded_date_length;
+    memcpy(p, this->url_suffix.data(), this->url_suffix.size());
+    p += this->url_suffix.size();
+    *p = '\0';
+
+    return p - url;
+}
+
+/**
+ * @brief 以当前时间生成鉴权url，写入调用者提供的缓冲区
+ * @param url 鉴权url缓冲区，结果以'\0'结尾
+ * @param size 缓冲区长度，需大于get_url_length()
+ * @return 鉴权url的长度，缓冲区不足时返回0
+ */
+size_t iflytek_authorizer::get_url(char *url, size_t size) const
+{
+    return this->get_url(url, size, time(NULL));
+}
+
+/**
+ * @brief 以当前时间生成鉴权url
+ * @return 鉴权url
+ */
+std::string iflytek_authorizer::get_url() const
+{
+    char url[1024];
+    size_t length = this->get_url(url, sizeof(url));
+    return std::string(url, length);
+}
+
+/**
+ * @brief 获得RFC1123格式的时间戳，例如"Thu, 05 Dec 2019 09:54:17 GMT"
+ * 每个线程缓存最近一秒的结果，同一秒内生成的鉴权url不再重复格式化
+ * @param now 时间
+ * @param date 时间戳
+ * @param encoded_date url编码后的时间戳
+ * @return 时间戳的长度
+ */
+size_t iflytek_authorizer::get_date(time_t now, const char **date, const char **encoded_date)
+{
+    static thread_local time_t cached_time = -1;
+    static thread_local char cached_date[32];
+    static thread_local char cached_encoded_date[32 * 3 + 1];
+    static thread_local size_t cached_length = 0;
+
+    if (now != cached_time)
+    {
+        struct tm gmt;
+        gmtime_r(&now, &gmt);
+        cached_length = strftime(cached_date, sizeof(cached_date), "%a, %d %b %Y %X %Z", &gmt);
+        cached_encoded_date[get_url_encode(cached_date, cached_length, cached_encoded_date)] = '\0';
+        cached_time = now;
+    }
+
+    *date = cached_date;
+    *encoded_date = cached_encoded_date;
+    return cached_length;
+}
+
+/**
+ * @brief 获得线程复用的摘要上下文
+ * 每个线程一个上下文，生成url时从预先计算的状态复制，线程结束时释放
+ * @return 摘要上下文，创建失败时返回NULL
+ */
+EVP_MD_CTX *iflytek_authorizer::get_digest_context()
+{
+    struct holder
+    {
+        EVP_MD_CTX *ctx;
+        holder() : ctx(EVP_MD_CTX_new()) {}
+        ~holder() { EVP_MD_CTX_free(this->ctx); }
+    };
+    static thread_local holder context;
+    return context.ctx;
+}
+
+#endif
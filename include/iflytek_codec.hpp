@@ -21,8 +21,15 @@
 #ifndef _IFLYTEK_CODEC_HPP
 #define _IFLYTEK_CODEC_HPP
 
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
+#include "iflytek_ogg_opus.hpp"
 #include "opus/opus.h"
 #include "speex/speex.h"
 
@@ -30,22 +37,31 @@
  * @brief 音频编解码抽象类
  * 
  * [public]
+ * @func ~iflytek_codec 虚析构函数
  * @func encode_create [纯虚函数]创建编码器
  * @func encode [纯虚函数]编码函数
+ * @func encode_batch [纯虚函数]批量编码函数，一次编码连续的多帧
+ * @func encode_reset [纯虚函数]重置编码器状态，用于编码新的音频流
  * @func encode_destroy [纯虚函数]销毁编码器
  * @func decode_create [纯虚函数]创建解码器
  * @func decode [纯虚函数]解码函数
+ * @func decode_reset [纯虚函数]重置解码器状态，用于解码新的音频流
  * @func decode_destroy [纯虚函数]销毁解码器
  */
 class iflytek_codec
 {
 public:
+    virtual ~iflytek_codec() {}
+
     // 派生类需要重载如下成员函数
     virtual int encode_create(const std::string type) = 0;
     virtual int encode(const unsigned char *source, const int source_length, unsigned char *dest) = 0;
+    virtual int encode_batch(const unsigned char *source, const int source_length, unsigned char *dest, std::vector<int> &offsets) = 0;
+    virtual void encode_reset() = 0;
     virtual void encode_destroy() = 0;
     virtual int decode_create(const std::string type) = 0;
     virtual int decode(const unsigned char *dest, const int dest_length, unsigned char *source) = 0;
+    virtual void decode_reset() = 0;
     virtual void decode_destroy() = 0;
 };
 
@@ -55,9 +71,12 @@ public:
  * [public]
  * @func encode_create 创建opus编码器
  * @func encode opus编码函数
+ * @func encode_batch opus批量编码函数
+ * @func encode_reset 重置opus编码器状态
  * @func encode_destroy 销毁opus编码器
  * @func decode_create 创建opus解码器
  * @func decode opus解码函数
+ * @func decode_reset 重置opus解码器状态
  * @func decode_destroy 销毁opus解码器
  * 
  * [private]
@@ -66,21 +85,25 @@ public:
  * @member sample_rate 待编解码音频的采样率
  * @member encoded_bitrate 待编码音频后的编码码率
  * @member frame_size 待编解码音频的帧大小，其与帧长度的区分请查阅相关资料
+ * @member max_frame_size 解码时一个包的最大帧大小（120ms）
  */
 class opus_codec : public iflytek_codec
 {
 public:
     int encode_create(const std::string type);
     int encode(const unsigned char *source, const int source_length, unsigned char *dest);
+    int encode_batch(const unsigned char *source, const int source_length, unsigned char *dest, std::vector<int> &offsets);
+    void encode_reset();
     void encode_destroy();
     int decode_create(const std::string type);
     int decode(const unsigned char *dest, const int dest_length, unsigned char *source);
+    void decode_reset();
     void decode_destroy();
 
 private:
     OpusEncoder *enc;
     OpusDecoder *dec;
-    int sample_rate, encoded_bitrate, frame_size;
+    int sample_rate, encoded_bitrate, frame_size, max_frame_size;
 };
 
 /**
@@ -89,9 +112,12 @@ private:
  * [public]
  * @func encode_create 创建speex编码器
  * @func encode speex编码函数
+ * @func encode_batch speex批量编码函数
+ * @func encode_reset 重置speex编码器状态
  * @func encode_destroy 销毁speex编码器
  * @func decode_create 创建speex解码器
  * @func decode speex解码函数
+ * @func decode_reset 重置speex解码器状态
  * @func decode_destroy 销毁speex解码器
  * 
  * [private]
@@ -106,9 +132,12 @@ class speex_codec : public iflytek_codec
 public:
     int encode_create(const std::string type);
     int encode(const unsigned char *source, const int source_length, unsigned char *dest);
+    int encode_batch(const unsigned char *source, const int source_length, unsigned char *dest, std::vector<int> &offsets);
+    void encode_reset();
     void encode_destroy();
     int decode_create(const std::string type);
     int decode(const unsigned char *dest, const int dest_length, unsigned char *source);
+    void decode_reset();
     void decode_destroy();
 
 private:
@@ -117,6 +146,114 @@ private:
     int sample_rate, quality, frame_size;
 };
 
+/**
+ * @brief 编解码器状态池
+ * 按音频格式分别保存空闲的编码器和解码器，会话结束时归还的编解码器只重置状态（OPUS_RESET_STATE/SPEEX_RESET_STATE），
+ * 不销毁，之后的会话直接取用已初始化的状态，避免每个会话重新分配并初始化编解码器；线程安全
+ *
+ * [public]
+ * @func get_instance 获得进程内共享的编解码器状态池
+ * @func iflytek_codec_pool 构造函数
+ * @func ~iflytek_codec_pool 析构函数，销毁所有空闲的编解码器
+ * @func set_max_idle 设置每种格式最多保留的空闲编码器（解码器）数
+ * @func get_encoder 取出一个空闲的编码器，没有时创建
+ * @func put_encoder 重置并归还编码器
+ * @func get_decoder 取出一个空闲的解码器，没有时创建
+ * @func put_decoder 重置并归还解码器
+ * @func clear 销毁所有空闲的编解码器
+ *
+ * [protected]
+ * @func create_codec 按音频格式创建编解码器对象
+ * @func get 从空闲列表取出编解码器，没有时创建
+ * @func put 重置编解码器并放回空闲列表，空闲列表已满时销毁
+ * @member lock 保护空闲列表的互斥锁
+ * @member encoders 按音频格式保存的空闲编码器及每帧原始数据长度
+ * @member decoders 按音频格式保存的空闲解码器及每帧原始数据长度
+ * @member max_idle 每种格式最多保留的空闲编码器（解码器）数
+ */
+class iflytek_codec_pool
+{
+public:
+    static iflytek_codec_pool &get_instance();
+
+    iflytek_codec_pool();
+    ~iflytek_codec_pool();
+    void set_max_idle(size_t max_idle);
+    iflytek_codec *get_encoder(const std::string &type, int &length);
+    void put_encoder(const std::string &type, iflytek_codec *codec);
+    iflytek_codec *get_decoder(const std::string &type, int &length);
+    void put_decoder(const std::string &type, iflytek_codec *codec);
+    void clear();
+
+protected:
+    struct codec_list
+    {
+        std::vector<iflytek_codec *> idle;
+        int length;
+    };
+    typedef std::map<std::string, codec_list> codec_map;
+
+    static iflytek_codec *create_codec(const std::string &type);
+    iflytek_codec *get(codec_map &codecs, const std::string &type, bool encoder, int &length);
+    void put(codec_map &codecs, const std::string &type, bool encoder, iflytek_codec *codec);
+
+private:
+    std::mutex lock;
+    codec_map encoders;
+    codec_map decoders;
+    size_t max_idle;
+};
+
+/**
+ * @brief 带帧头的speex/opus数据流（或ogg封装的opus数据流）的增量解码类
+ * 数据可以按任意长度分段输入，每凑齐一帧（帧头及帧数据）立即解码，pcm数据交给回调函数处理，
+ * 不完整的帧保存到下一次输入，帧头格式见本文件开头的表格；opus-ogg格式由ogg_opus_demuxer每凑齐一页取出其中的包解码
+ *
+ * [public]
+ * @func iflytek_stream_decoder 构造函数
+ * @func ~iflytek_stream_decoder 析构函数
+ * @func create 按音频格式创建解码器
+ * @func decode 输入一段数据，解码其中所有完整的帧
+ * @func get_pending_length 获得保存到下一次输入的不完整帧的字节数
+ * @func destroy 归还解码器，丢弃不完整的帧
+ *
+ * [protected]
+ * @func decode_frame 解码一帧数据并交给回调函数
+ * @func get_frame_length 按帧头获得一帧数据的长度
+ * @member codec 解码器，从iflytek_codec_pool取出
+ * @member codec_type 解码器类型，归还解码器时使用
+ * @member demuxer opus-ogg格式的解封装器，其他格式为NULL
+ * @member head_length 帧头的字节数，speex为1字节，opus为2字节（大端）
+ * @member pcm 解码输出缓冲区
+ * @member pending 不完整的帧
+ * @member on_pcm pcm数据回调函数
+ */
+class iflytek_stream_decoder
+{
+public:
+    typedef std::function<void(const unsigned char *pcm, int pcm_length)> pcm_handler;
+
+    iflytek_stream_decoder();
+    ~iflytek_stream_decoder();
+    int create(const std::string type, pcm_handler on_pcm);
+    int decode(const unsigned char *data, size_t length);
+    size_t get_pending_length() const;
+    void destroy();
+
+protected:
+    int decode_frame(const unsigned char *frame, int frame_length);
+    size_t get_frame_length(const unsigned char *head) const;
+
+private:
+    iflytek_codec *codec;
+    std::string codec_type;
+    ogg_opus_demuxer *demuxer;
+    size_t head_length;
+    std::vector<unsigned char> pcm;
+    std::vector<unsigned char> pending;
+    pcm_handler on_pcm;
+};
+
 /**
  * @brief 创建opus编码器
  * @param type 编码器类型
@@ -187,6 +324,42 @@ int opus_codec::encode(const unsigned char *source, const int source_length, uns
     }
 }
 
+/**
+ * @brief opus批量编码函数
+ * 原始数据包含连续的多帧，每帧编码为带帧头的数据并依次写入目的数据，整批只有一次虚函数调用
+ * @param source 原始数据，长度不足一帧的部分不编码
+ * @param source_length 原始数据字节长度
+ * @param dest 目的数据，长度不小于帧数 * (每帧原始数据长度 + 2)
+ * @param offsets 每帧目的数据的起始位置，最后追加目的数据的总长度，第i帧为[offsets[i], offsets[i + 1])
+ * @return 成功时返回目的数据的字节长度，失败时返回-1
+ */
+int opus_codec::encode_batch(const unsigned char *source, const int source_length, unsigned char *dest, std::vector<int> &offsets)
+{
+    int frame_length = this->frame_size * 2;
+    int length = 0;
+    offsets.clear();
+    offsets.push_back(0);
+    for (int pos = 0; pos + frame_length <= source_length; pos += frame_length)
+    {
+        int nbytes = this->opus_codec::encode(source + pos, frame_length, dest + length);
+        if (nbytes == -1)
+        {
+            return -1;
+        }
+        length += nbytes;
+        offsets.push_back(length);
+    }
+    return length;
+}
+
+/**
+ * @brief 重置opus编码器状态，等同于重新创建的编码器
+ */
+void opus_codec::encode_reset()
+{
+    opus_encoder_ctl(this->enc, OPUS_RESET_STATE);
+}
+
 /**
  * @brief 销毁opus编码器
  */
@@ -199,7 +372,7 @@ void opus_codec::encode_destroy()
  * @brief 创建opus解码器
  * @param type 解码器类型
  * 目前可选值有opus, opus-wb
- * @return 成功时返回原始数据的字节长度，失败时返回-1
+ * @return 成功时返回一个包解码后原始数据的最大字节长度，失败时返回-1
  */
 int opus_codec::decode_create(const std::string type)
 {
@@ -217,8 +390,9 @@ int opus_codec::decode_create(const std::string type)
         return -1;
     }
 
-    // 经测试，目前讯飞云引擎opus编解码只支持帧时长为20ms的数据
+    // 经测试，目前讯飞云引擎opus编解码只支持帧时长为20ms的数据，解码时一个包最长可以为120ms
     this->frame_size = this->sample_rate * 0.02;
+    this->max_frame_size = this->sample_rate * 0.12;
 
     int err = 0;
     this->dec = opus_decoder_create(this->sample_rate, 1, &err);
@@ -229,7 +403,7 @@ int opus_codec::decode_create(const std::string type)
     }
     else
     {
-        return this->frame_size * 2;
+        return this->max_frame_size * 2;
     }
 }
 
@@ -242,7 +416,7 @@ int opus_codec::decode_create(const std::string type)
  */
 int opus_codec::decode(const unsigned char *dest, const int dest_length, unsigned char *source)
 {
-    int samples = opus_decode(this->dec, dest, dest_length, (opus_int16 *)source, this->frame_size, 0);
+    int samples = opus_decode(this->dec, dest, dest_length, (opus_int16 *)source, this->max_frame_size, 0);
     if (samples < 0)
     {
         fprintf(stderr, "[ERROR] Failed to opus_decode opus data\n");
@@ -254,6 +428,14 @@ int opus_codec::decode(const unsigned char *dest, const int dest_length, unsigne
     }
 }
 
+/**
+ * @brief 重置opus解码器状态，等同于重新创建的解码器
+ */
+void opus_codec::decode_reset()
+{
+    opus_decoder_ctl(this->dec, OPUS_RESET_STATE);
+}
+
 /**
  * @brief 销毁opus解码器
  */
@@ -331,6 +513,44 @@ int speex_codec::encode(const unsigned char *source, const int source_length, un
     }
 }
 
+/**
+ * @brief speex批量编码函数
+ * 原始数据包含连续的多帧，每帧编码为带帧头的数据并依次写入目的数据，整批只有一次虚函数调用
+ * @param source 原始数据，长度不足一帧的部分不编码
+ * @param source_length 原始数据字节长度
+ * @param dest 目的数据，长度不小于帧数 * (每帧原始数据长度 + 1)
+ * @param offsets 每帧目的数据的起始位置，最后追加目的数据的总长度，第i帧为[offsets[i], offsets[i + 1])
+ * @return 成功时返回目的数据的字节长度，失败时返回-1
+ */
+int speex_codec::encode_batch(const unsigned char *source, const int source_length, unsigned char *dest, std::vector<int> &offsets)
+{
+    int frame_length = this->frame_size * 2;
+    int length = 0;
+    offsets.clear();
+    offsets.push_back(0);
+    for (int pos = 0; pos + frame_length <= source_length; pos += frame_length)
+    {
+        int nbytes = this->speex_codec::encode(source + pos, frame_length, dest + length);
+        if (nbytes == -1)
+        {
+            return -1;
+        }
+        length += nbytes;
+        offsets.push_back(length);
+    }
+    return length;
+}
+
+/**
+ * @brief 重置speex编码器状态，用于编码新的音频流
+ * SPEEX_RESET_STATE只清除信号历史，VBR分析等自适应状态保留，最初约10帧的编码结果与新创建的编码器不逐字节相同，但仍是有效的码流
+ */
+void speex_codec::encode_reset()
+{
+    speex_encoder_ctl(this->enc_state, SPEEX_RESET_STATE, NULL);
+    speex_bits_reset(&this->enc_bits);
+}
+
 /**
  * @brief 销毁speex编码器
  */
@@ -397,6 +617,16 @@ int speex_codec::decode(const unsigned char *dest, const int dest_length, unsign
     }
 }
 
+/**
+ * @brief 重置speex解码器状态，用于解码新的音频流
+ * 与编码器相同，SPEEX_RESET_STATE之后最初几帧的输出与新创建的解码器略有差异
+ */
+void speex_codec::decode_reset()
+{
+    speex_decoder_ctl(this->dec_state, SPEEX_RESET_STATE, NULL);
+    speex_bits_reset(&this->dec_bits);
+}
+
 /**
  * @brief 销毁speex解码器
  */
@@ -406,4 +636,414 @@ void speex_codec::decode_destroy()
     speex_decoder_destroy(this->dec_state);
 }
 
-#endif
\ No newline at end of file
+/**
+ * @brief 获得进程内共享的编解码器状态池
+ * @return 编解码器状态池，在第一次调用时创建
+ */
+iflytek_codec_pool &iflytek_codec_pool::get_instance()
+{
+    static iflytek_codec_pool pool;
+    return pool;
+}
+
+/**
+ * @brief 构造函数
+ * 每种格式默认最多保留64个空闲的编码器（解码器）
+ */
+iflytek_codec_pool::iflytek_codec_pool()
+    : max_idle(64)
+{
+}
+
+/**
+ * @brief 析构函数
+ * 销毁所有空闲的编解码器，取出后未归还的编解码器由使用者负责
+ */
+iflytek_codec_pool::~iflytek_codec_pool()
+{
+    this->clear();
+}
+
+/**
+ * @brief 设置每种格式最多保留的空闲编码器（解码器）数
+ * @param max_idle 最多保留的空闲数，0表示不保留，归还时直接销毁
+ */
+void iflytek_codec_pool::set_max_idle(size_t max_idle)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->max_idle = max_idle;
+}
+
+/**
+ * @brief 取出一个空闲的编码器，没有时创建
+ * @param type 编码器类型
+ * 目前可选值有opus, opus-wb, speex, speex-wb
+ * @param length 返回编码器接受原始数据的每帧长度，同encode_create的返回值
+ * @return 成功时返回已创建的编码器，失败时返回NULL
+ */
+iflytek_codec *iflytek_codec_pool::get_encoder(const std::string &type, int &length)
+{
+    return this->get(this->encoders, type, true, length);
+}
+
+/**
+ * @brief 重置并归还编码器，归还后不能再使用
+ * @param type 编码器类型，与get_encoder时相同
+ * @param codec 编码器
+ */
+void iflytek_codec_pool::put_encoder(const std::string &type, iflytek_codec *codec)
+{
+    this->put(this->encoders, type, true, codec);
+}
+
+/**
+ * @brief 取出一个空闲的解码器，没有时创建
+ * @param type 解码器类型
+ * 目前可选值有opus, opus-wb, speex, speex-wb
+ * @param length 返回解码后原始数据的每帧（最大）长度，同decode_create的返回值
+ * @return 成功时返回已创建的解码器，失败时返回NULL
+ */
+iflytek_codec *iflytek_codec_pool::get_decoder(const std::string &type, int &length)
+{
+    return this->get(this->decoders, type, false, length);
+}
+
+/**
+ * @brief 重置并归还解码器，归还后不能再使用
+ * @param type 解码器类型，与get_decoder时相同
+ * @param codec 解码器
+ */
+void iflytek_codec_pool::put_decoder(const std::string &type, iflytek_codec *codec)
+{
+    this->put(this->decoders, type, false, codec);
+}
+
+/**
+ * @brief 销毁所有空闲的编解码器
+ */
+void iflytek_codec_pool::clear()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    for (auto &item : this->encoders)
+    {
+        for (iflytek_codec *codec : item.second.idle)
+        {
+            codec->encode_destroy();
+            delete codec;
+        }
+        item.second.idle.clear();
+    }
+    for (auto &item : this->decoders)
+    {
+        for (iflytek_codec *codec : item.second.idle)
+        {
+            codec->decode_destroy();
+            delete codec;
+        }
+        item.second.idle.clear();
+    }
+}
+
+/**
+ * @brief 按音频格式创建编解码器对象
+ * @param type 音频格式
+ * @return 成功时返回未创建编码器或解码器的对象，格式不支持时返回NULL
+ */
+iflytek_codec *iflytek_codec_pool::create_codec(const std::string &type)
+{
+    if ("opus" == type || "opus-wb" == type)
+    {
+        return new opus_codec;
+    }
+    if ("speex" == type || "speex-wb" == type)
+    {
+        return new speex_codec;
+    }
+    fprintf(stderr, "[ERROR] Unsupported codec format \"%s\"\n", type.c_str());
+    return NULL;
+}
+
+/**
+ * @brief 从空闲列表取出编解码器，没有时在锁外创建
+ * @param codecs 空闲的编码器或解码器列表
+ * @param type 音频格式
+ * @param encoder 是否为编码器
+ * @param length 返回每帧原始数据长度
+ * @return 成功时返回编解码器，失败时返回NULL
+ */
+iflytek_codec *iflytek_codec_pool::get(codec_map &codecs, const std::string &type, bool encoder, int &length)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        auto it = codecs.find(type);
+        if (it != codecs.end() && !it->second.idle.empty())
+        {
+            iflytek_codec *codec = it->second.idle.back();
+            it->second.idle.pop_back();
+            length = it->second.length;
+            return codec;
+        }
+    }
+
+    iflytek_codec *codec = create_codec(type);
+    if (codec == NULL)
+    {
+        return NULL;
+    }
+    length = encoder ? codec->encode_create(type) : codec->decode_create(type);
+    if (length == -1)
+    {
+        delete codec;
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    codecs[type].length = length;
+    return codec;
+}
+
+/**
+ * @brief 重置编解码器并放回空闲列表，空闲列表已满时销毁
+ * @param codecs 空闲的编码器或解码器列表
+ * @param type 音频格式
+ * @param encoder 是否为编码器
+ * @param codec 编解码器
+ */
+void iflytek_codec_pool::put(codec_map &codecs, const std::string &type, bool encoder, iflytek_codec *codec)
+{
+    if (codec == NULL)
+    {
+        return;
+    }
+
+    // 重置状态只涉及该编解码器本身，在锁外进行
+    if (encoder)
+    {
+        codec->encode_reset();
+    }
+    else
+    {
+        codec->decode_reset();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        codec_list &list = codecs[type];
+        if (list.idle.size() < this->max_idle)
+        {
+            list.idle.push_back(codec);
+            return;
+        }
+    }
+
+    if (encoder)
+    {
+        codec->encode_destroy();
+    }
+    else
+    {
+        codec->decode_destroy();
+    }
+    delete codec;
+}
+
+/**
+ * @brief 构造函数
+ * 需要调用create创建解码器后才能解码
+ */
+iflytek_stream_decoder::iflytek_stream_decoder()
+    : codec(NULL), demuxer(NULL), head_length(0)
+{
+}
+
+/**
+ * @brief 析构函数
+ */
+iflytek_stream_decoder::~iflytek_stream_decoder()
+{
+    this->destroy();
+}
+
+/**
+ * @brief 按音频格式创建解码器
+ * @param type 音频格式
+ * 目前可选值有speex, speex-wb, opus, opus-wb, opus-ogg（解码为16kHz）
+ * @param on_pcm pcm数据回调函数，每解码一帧调用一次
+ * @return 成功时返回每帧pcm数据的字节长度，失败时返回-1
+ */
+int iflytek_stream_decoder::create(const std::string type, pcm_handler on_pcm)
+{
+    this->destroy();
+
+    if ("speex" == type || "speex-wb" == type)
+    {
+        this->head_length = 1;
+        this->codec_type = type;
+    }
+    else if ("opus" == type || "opus-wb" == type)
+    {
+        this->head_length = 2;
+        this->codec_type = type;
+    }
+    else if ("opus-ogg" == type)
+    {
+        this->codec_type = "opus-wb";
+    }
+    else
+    {
+        fprintf(stderr, "[ERROR] Unsupported decoding format \"%s\"\n", type.c_str());
+        return -1;
+    }
+
+    // 解码器从状态池取出，销毁时重置后归还
+    int pcm_length;
+    this->codec = iflytek_codec_pool::get_instance().get_decoder(this->codec_type, pcm_length);
+    if (this->codec == NULL)
+    {
+        return -1;
+    }
+    if ("opus-ogg" == type)
+    {
+        this->demuxer = new ogg_opus_demuxer([this](const unsigned char *packet, size_t packet_length) {
+            return this->decode_frame(packet, packet_length) == 0;
+        });
+    }
+
+    this->pcm.resize(pcm_length);
+    this->on_pcm = on_pcm;
+    return pcm_length;
+}
+
+/**
+ * @brief 输入一段数据，解码其中所有完整的帧
+ * 上一次输入剩余的不完整帧先与本次数据拼接，之后的完整帧直接在输入数据上解码，不复制
+ * @param data 带帧头的编码数据，或ogg封装的数据
+ * @param length 数据长度
+ * @return 成功时返回本次解码的帧数，解码失败时返回-1
+ */
+int iflytek_stream_decoder::decode(const unsigned char *data, size_t length)
+{
+    if (this->codec == NULL)
+    {
+        return -1;
+    }
+    if (this->demuxer != NULL)
+    {
+        return this->demuxer->demux(data, length);
+    }
+
+    int count = 0;
+    const unsigned char *end = data + length;
+
+    // 补全上一次输入剩余的不完整帧
+    if (!this->pending.empty())
+    {
+        size_t need = this->head_length;
+        if (this->pending.size() >= this->head_length)
+        {
+            need += this->get_frame_length(this->pending.data());
+        }
+        while (this->pending.size() < need && data != end)
+        {
+            size_t copy = std::min(need - this->pending.size(), (size_t)(end - data));
+            this->pending.insert(this->pending.end(), data, data + copy);
+            data += copy;
+            if (this->pending.size() == this->head_length)
+            {
+                need += this->get_frame_length(this->pending.data());
+            }
+        }
+        if (this->pending.size() < need)
+        {
+            return 0;
+        }
+
+        if (this->decode_frame(this->pending.data() + this->head_length, need - this->head_length) == -1)
+        {
+            return -1;
+        }
+        this->pending.clear();
+        count++;
+    }
+
+    // 直接解码输入数据中的完整帧
+    while ((size_t)(end - data) >= this->head_length)
+    {
+        size_t frame_length = this->get_frame_length(data);
+        if ((size_t)(end - data) < this->head_length + frame_length)
+        {
+            break;
+        }
+        if (this->decode_frame(data + this->head_length, frame_length) == -1)
+        {
+            return -1;
+        }
+        data += this->head_length + frame_length;
+        count++;
+    }
+
+    // 保存不完整的帧
+    this->pending.insert(this->pending.end(), data, end);
+    return count;
+}
+
+/**
+ * @brief 获得保存到下一次输入的不完整帧的字节数
+ * @return 不完整帧的字节数，数据流结束时不为0说明最后一帧被截断
+ */
+size_t iflytek_stream_decoder::get_pending_length() const
+{
+    return this->demuxer != NULL ? this->demuxer->get_pending_length() : this->pending.size();
+}
+
+/**
+ * @brief 归还解码器，丢弃不完整的帧
+ */
+void iflytek_stream_decoder::destroy()
+{
+    if (this->codec != NULL)
+    {
+        iflytek_codec_pool::get_instance().put_decoder(this->codec_type, this->codec);
+        this->codec = NULL;
+    }
+    delete this->demuxer;
+    this->demuxer = NULL;
+    this->pending.clear();
+}
+
+/**
+ * @brief 解码一帧数据并交给回调函数，长度为0的帧跳过
+ * @param frame 不含帧头的帧数据
+ * @param frame_length 帧数据长度
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_stream_decoder::decode_frame(const unsigned char *frame, int frame_length)
+{
+    if (frame_length == 0)
+    {
+        return 0;
+    }
+
+    int pcm_length = this->codec->decode(frame, frame_length, this->pcm.data());
+    if (pcm_length == -1)
+    {
+        return -1;
+    }
+    if (this->on_pcm)
+    {
+        this->on_pcm(this->pcm.data(), pcm_length);
+    }
+    return 0;
+}
+
+/**
+ * @brief 按帧头获得一帧数据的长度
+ * @param head 帧头
+ * @return 不含帧头的帧数据长度
+ */
+size_t iflytek_stream_decoder::get_frame_length(const unsigned char *head) const
+{
+    return this->head_length == 1 ? head[0] : ((size_t)head[0] << 8) | head[1];
+}
+
+#endif
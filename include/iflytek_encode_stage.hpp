@@ -0,0 +1,543 @@
+/**
+ * @Copyright: https://www.xfyun.cn/
+ * @Author: iflytek
+ * @Data: 2019-12-20
+ *
+ * 本文件包含多核并行的音频编码阶段类定义及实现
+ * iflytek_encode_stage启动固定数量的编码线程（默认每个CPU核一个），每个会话按哈希固定到一个编码线程，
+ * 原始音频和编码结果分别通过单生产者单消费者的无锁环形缓冲区在会话的发送线程和编码线程之间传递，
+ * 会话的编码器只在其编码线程上使用，编码状态保留在该核的缓存中
+ */
+
+#ifndef _IFLYTEK_ENCODE_STAGE_HPP
+#define _IFLYTEK_ENCODE_STAGE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "iflytek_codec.hpp"
+
+/**
+ * @brief 单生产者单消费者的无锁环形缓冲区
+ * 缓冲区由固定数量、固定大小的槽组成，生产者就地写入空闲槽后提交，消费者就地读取最早的槽后释放，
+ * 只有一个线程写入、一个线程读取时无需加锁
+ *
+ * [public]
+ * @func iflytek_spsc_ring 构造函数
+ * @func back 获得可写入的空闲槽（生产者）
+ * @func push 提交已写入的槽（生产者）
+ * @func front 获得最早提交的槽（消费者）
+ * @func pop 释放最早提交的槽（消费者）
+ *
+ * [private]
+ * @member slots 所有槽的数据
+ * @member lengths 每个槽中数据的长度
+ * @member mask 槽数减一，槽数为2的幂
+ * @member slot_size 每个槽的字节数
+ * @member pad0, pad1 填充，使head和tail位于不同的缓存行
+ * @member head 消费者的读取位置
+ * @member tail 生产者的写入位置
+ */
+class iflytek_spsc_ring
+{
+public:
+    iflytek_spsc_ring(size_t slot_count, size_t slot_size);
+    unsigned char *back();
+    void push(int length);
+    const unsigned char *front(int &length) const;
+    void pop();
+
+private:
+    std::vector<unsigned char> slots;
+    std::vector<int> lengths;
+    size_t mask, slot_size;
+    char pad0[64];
+    std::atomic<size_t> head;
+    char pad1[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+};
+
+class iflytek_encode_worker;
+
+/**
+ * @brief 会话的编码流
+ * 由iflytek_encode_stage::open创建，发送线程写入原始音频并读取编码结果，编码器由所属的编码线程使用
+ * 输入的每个槽包含若干帧原始音频，编码后的槽包含对应的带帧头的数据（见iflytek_codec::encode_batch）
+ *
+ * [public]
+ * @func get_input 获得可写入原始音频的槽，输入缓冲区满时返回NULL
+ * @func put_input 提交原始音频并唤醒编码线程
+ * @func get_output 获得最早完成编码的数据
+ * @func pop_output 释放最早完成编码的数据
+ * @func get_pending 获得已提交但编码结果尚未释放的槽数
+ *
+ * [private]
+ * @member type 编码器类型
+ * @member codec 编码器，只在编码线程上使用
+ * @member input 原始音频的环形缓冲区
+ * @member output 编码结果的环形缓冲区
+ * @member worker 所属的编码线程
+ * @member closed 会话是否已关闭该编码流，关闭后由编码线程销毁
+ * @member pending 已提交但编码结果尚未释放的槽数，只在发送线程上使用
+ */
+class iflytek_encode_stream
+{
+    friend class iflytek_encode_stage;
+    friend class iflytek_encode_worker;
+
+public:
+    unsigned char *get_input();
+    void put_input(int length);
+    const unsigned char *get_output(int &length) const;
+    void pop_output();
+    int get_pending() const;
+
+private:
+    iflytek_encode_stream(const std::string &type, iflytek_codec *codec, int frame_length, int frames, iflytek_encode_worker *worker);
+
+    std::string type;
+    iflytek_codec *codec;
+    iflytek_spsc_ring input, output;
+    iflytek_encode_worker *worker;
+    std::atomic<bool> closed;
+    int pending;
+};
+
+/**
+ * @brief 编码线程
+ * 依次为固定到该线程的编码流编码所有已提交的原始音频，没有待编码的数据时等待唤醒
+ *
+ * [public]
+ * @func iflytek_encode_worker 构造函数，启动编码线程
+ * @func ~iflytek_encode_worker 析构函数，停止编码线程并销毁其上所有的编码流
+ * @func attach 将编码流固定到该线程
+ * @func notify 唤醒等待中的编码线程
+ *
+ * [protected]
+ * @func run 编码线程的主循环
+ * @func encode 为一个编码流编码所有已提交的原始音频
+ * @func has_work 是否有待处理的编码流
+ * @member thread 编码线程
+ * @member lock 保护attached、signaled及stopping的互斥锁
+ * @member wakeup 唤醒编码线程的条件变量
+ * @member streams 编码线程上的编码流，只在编码线程上访问
+ * @member attached 新固定到该线程、尚未被编码线程接收的编码流
+ * @member sleeping 编码线程是否准备等待
+ * @member signaled 是否有尚未处理的唤醒
+ * @member stopping 是否停止编码线程
+ */
+class iflytek_encode_worker
+{
+public:
+    iflytek_encode_worker();
+    ~iflytek_encode_worker();
+    void attach(iflytek_encode_stream *stream);
+    void notify();
+
+protected:
+    void run();
+    static bool encode(iflytek_encode_stream *stream, std::vector<int> &offsets);
+    bool has_work();
+
+private:
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::vector<iflytek_encode_stream *> streams;
+    std::vector<iflytek_encode_stream *> attached;
+    std::atomic<bool> sleeping;
+    bool signaled, stopping;
+};
+
+/**
+ * @brief 多核并行的音频编码阶段
+ * 所有会话共享，会话按key的哈希固定到一个编码线程，编码器从iflytek_codec_pool取出，关闭编码流时重置并归还
+ *
+ * [public]
+ * @func iflytek_encode_stage 构造函数，启动编码线程
+ * @func ~iflytek_encode_stage 析构函数，停止所有编码线程
+ * @func open 为会话创建编码流
+ * @func close 关闭编码流，之后不能再使用
+ * @func get_worker_count 获得编码线程数
+ *
+ * [private]
+ * @member workers 编码线程
+ */
+class iflytek_encode_stage
+{
+public:
+    iflytek_encode_stage(int worker_count);
+    ~iflytek_encode_stage();
+    iflytek_encode_stream *open(int key, const std::string &type, int frames, int &frame_length);
+    void close(iflytek_encode_stream *stream);
+    int get_worker_count() const;
+
+private:
+    std::vector<iflytek_encode_worker *> workers;
+};
+
+/**
+ * @brief 构造函数
+ * @param slot_count 槽数，向上取整为2的幂
+ * @param slot_size 每个槽的字节数
+ */
+iflytek_spsc_ring::iflytek_spsc_ring(size_t slot_count, size_t slot_size)
+    : slot_size(slot_size), head(0), tail(0)
+{
+    size_t count = 1;
+    while (count < slot_count)
+    {
+        count <<= 1;
+    }
+    this->mask = count - 1;
+    this->slots.resize(count * slot_size);
+    this->lengths.resize(count);
+}
+
+/**
+ * @brief 获得可写入的空闲槽，只能由生产者调用
+ * @return 空闲槽的首地址，缓冲区满时返回NULL
+ */
+unsigned char *iflytek_spsc_ring::back()
+{
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    if (tail - this->head.load(std::memory_order_acquire) > this->mask)
+    {
+        return NULL;
+    }
+    return &this->slots[(tail & this->mask) * this->slot_size];
+}
+
+/**
+ * @brief 提交back返回的槽，只能由生产者调用
+ * @param length 写入的数据长度
+ */
+void iflytek_spsc_ring::push(int length)
+{
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    this->lengths[tail & this->mask] = length;
+    this->tail.store(tail + 1, std::memory_order_release);
+}
+
+/**
+ * @brief 获得最早提交的槽，只能由消费者调用
+ * @param length 返回该槽中数据的长度
+ * @return 槽的首地址，缓冲区空时返回NULL
+ */
+const unsigned char *iflytek_spsc_ring::front(int &length) const
+{
+    size_t head = this->head.load(std::memory_order_relaxed);
+    if (head == this->tail.load(std::memory_order_acquire))
+    {
+        return NULL;
+    }
+    length = this->lengths[head & this->mask];
+    return &this->slots[(head & this->mask) * this->slot_size];
+}
+
+/**
+ * @brief 释放front返回的槽，只能由消费者调用
+ */
+void iflytek_spsc_ring::pop()
+{
+    this->head.store(this->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+ * @brief 构造函数
+ * 输入和编码结果各有8个槽，每个槽存放frames帧
+ * @param type 编码器类型
+ * @param codec 已创建的编码器
+ * @param frame_length 每帧原始音频的字节数
+ * @param frames 每个槽存放的帧数
+ * @param worker 所属的编码线程
+ */
+iflytek_encode_stream::iflytek_encode_stream(const std::string &type, iflytek_codec *codec, int frame_length, int frames, iflytek_encode_worker *worker)
+    : type(type), codec(codec), input(8, frame_length * frames), output(8, (frame_length + 2) * frames),
+      worker(worker), closed(false), pending(0)
+{
+}
+
+/**
+ * @brief 获得可写入原始音频的槽
+ * @return 槽的首地址，可写入frames帧原始音频，输入缓冲区满时返回NULL
+ */
+unsigned char *iflytek_encode_stream::get_input()
+{
+    return this->input.back();
+}
+
+/**
+ * @brief 提交get_input返回的槽并唤醒编码线程
+ * @param length 原始音频的字节数，不足一帧的部分不编码
+ */
+void iflytek_encode_stream::put_input(int length)
+{
+    this->input.push(length);
+    this->pending++;
+    this->worker->notify();
+}
+
+/**
+ * @brief 获得最早完成编码的数据
+ * @param length 返回编码结果的长度，编码失败时为-1
+ * @return 编码结果的首地址，没有完成编码的数据时返回NULL
+ */
+const unsigned char *iflytek_encode_stream::get_output(int &length) const
+{
+    return this->output.front(length);
+}
+
+/**
+ * @brief 释放get_output返回的数据，输出缓冲区腾出空间后唤醒编码线程
+ */
+void iflytek_encode_stream::pop_output()
+{
+    this->output.pop();
+    this->pending--;
+    this->worker->notify();
+}
+
+/**
+ * @brief 获得已提交但编码结果尚未释放的槽数
+ * @return 槽数，为0时所有提交的音频都已编码并取出
+ */
+int iflytek_encode_stream::get_pending() const
+{
+    return this->pending;
+}
+
+/**
+ * @brief 构造函数，启动编码线程
+ */
+iflytek_encode_worker::iflytek_encode_worker()
+    : sleeping(false), signaled(false), stopping(false)
+{
+    this->thread = std::thread(&iflytek_encode_worker::run, this);
+}
+
+/**
+ * @brief 析构函数
+ * 停止编码线程，销毁其上所有的编码流，编码器归还给iflytek_codec_pool
+ */
+iflytek_encode_worker::~iflytek_encode_worker()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->wakeup.notify_one();
+    this->thread.join();
+
+    this->streams.insert(this->streams.end(), this->attached.begin(), this->attached.end());
+    for (iflytek_encode_stream *stream : this->streams)
+    {
+        iflytek_codec_pool::get_instance().put_encoder(stream->type, stream->codec);
+        delete stream;
+    }
+}
+
+/**
+ * @brief 将编码流固定到该线程，编码线程在下一次循环时接收
+ * @param stream 编码流
+ */
+void iflytek_encode_worker::attach(iflytek_encode_stream *stream)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->attached.push_back(stream);
+    }
+    this->notify();
+}
+
+/**
+ * @brief 唤醒等待中的编码线程
+ * 编码线程没有准备等待时只读取一次原子变量，不加锁
+ */
+void iflytek_encode_worker::notify()
+{
+    // 与run中的sleeping.store配对，保证提交的数据和sleeping至少有一方被对方看到
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->sleeping.load(std::memory_order_relaxed))
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->signaled = true;
+        }
+        this->wakeup.notify_one();
+    }
+}
+
+/**
+ * @brief 编码线程的主循环
+ * 接收新固定的编码流，为每个编码流编码所有已提交的原始音频，销毁已关闭的编码流；
+ * 没有任何工作时先声明准备等待，再检查一次，确认没有工作后等待唤醒
+ */
+void iflytek_encode_worker::run()
+{
+    std::vector<int> offsets;
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            if (this->stopping)
+            {
+                return;
+            }
+            this->streams.insert(this->streams.end(), this->attached.begin(), this->attached.end());
+            this->attached.clear();
+        }
+
+        bool busy = false;
+        for (size_t i = 0; i < this->streams.size();)
+        {
+            iflytek_encode_stream *stream = this->streams[i];
+            if (stream->closed.load(std::memory_order_acquire))
+            {
+                iflytek_codec_pool::get_instance().put_encoder(stream->type, stream->codec);
+                delete stream;
+                this->streams[i] = this->streams.back();
+                this->streams.pop_back();
+                continue;
+            }
+            busy = encode(stream, offsets) || busy;
+            i++;
+        }
+        if (busy)
+        {
+            continue;
+        }
+
+        this->sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (this->has_work())
+        {
+            this->sleeping.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->wakeup.wait_for(guard, std::chrono::milliseconds(100), [this] { return this->signaled || this->stopping || !this->attached.empty(); });
+        this->signaled = false;
+        this->sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief 为一个编码流编码所有已提交的原始音频，直到输入为空或输出已满
+ * @param stream 编码流
+ * @param offsets encode_batch使用的各帧偏移，在调用之间复用
+ * @return 编码了至少一个槽时返回true
+ */
+bool iflytek_encode_worker::encode(iflytek_encode_stream *stream, std::vector<int> &offsets)
+{
+    bool busy = false;
+    const unsigned char *source;
+    unsigned char *dest;
+    int length;
+    while ((source = stream->input.front(length)) != NULL && (dest = stream->output.back()) != NULL)
+    {
+        stream->output.push(stream->codec->encode_batch(source, length, dest, offsets));
+        stream->input.pop();
+        busy = true;
+    }
+    return busy;
+}
+
+/**
+ * @brief 是否有待处理的编码流
+ * @return 有新固定或已关闭的编码流，或者有编码流可以编码时返回true
+ */
+bool iflytek_encode_worker::has_work()
+{
+    int length;
+    for (iflytek_encode_stream *stream : this->streams)
+    {
+        if (stream->closed.load(std::memory_order_acquire) ||
+            (stream->input.front(length) != NULL && stream->output.back() != NULL))
+        {
+            return true;
+        }
+    }
+    std::lock_guard<std::mutex> guard(this->lock);
+    return !this->attached.empty();
+}
+
+/**
+ * @brief 构造函数，启动编码线程
+ * @param worker_count 编码线程数，不大于0时每个CPU核一个编码线程
+ */
+iflytek_encode_stage::iflytek_encode_stage(int worker_count)
+{
+    if (worker_count <= 0)
+    {
+        worker_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < worker_count; i++)
+    {
+        this->workers.push_back(new iflytek_encode_worker);
+    }
+}
+
+/**
+ * @brief 析构函数，停止所有编码线程，尚未关闭的编码流一并销毁
+ */
+iflytek_encode_stage::~iflytek_encode_stage()
+{
+    for (iflytek_encode_worker *worker : this->workers)
+    {
+        delete worker;
+    }
+}
+
+/**
+ * @brief 为会话创建编码流
+ * 编码器从iflytek_codec_pool取出，编码流按key的哈希固定到一个编码线程
+ * @param key 会话标识，例如会话id
+ * @param type 编码器类型
+ * 目前可选值有opus, opus-wb, speex, speex-wb
+ * @param frames 每个槽存放的帧数
+ * @param frame_length 返回每帧原始音频的字节数
+ * @return 成功时返回编码流，失败时返回NULL
+ */
+iflytek_encode_stream *iflytek_encode_stage::open(int key, const std::string &type, int frames, int &frame_length)
+{
+    iflytek_codec *codec = iflytek_codec_pool::get_instance().get_encoder(type, frame_length);
+    if (codec == NULL)
+    {
+        return NULL;
+    }
+
+    iflytek_encode_worker *worker = this->workers[std::hash<int>()(key) % this->workers.size()];
+    iflytek_encode_stream *stream = new iflytek_encode_stream(type, codec, frame_length, frames, worker);
+    worker->attach(stream);
+    return stream;
+}
+
+/**
+ * @brief 关闭编码流，未取出的编码结果被丢弃，编码流由其编码线程销毁
+ * @param stream 编码流，关闭后不能再使用
+ */
+void iflytek_encode_stage::close(iflytek_encode_stream *stream)
+{
+    iflytek_encode_worker *worker = stream->worker;
+    stream->closed.store(true, std::memory_order_release);
+    worker->notify();
+}
+
+/**
+ * @brief 获得编码线程数
+ * @return 编码线程数
+ */
+int iflytek_encode_stage::get_worker_count() const
+{
+    return this->workers.size();
+}
+
+#endif
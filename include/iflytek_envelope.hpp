@@ -0,0 +1,207 @@
+/**
+ * @Copyright: https://www.xfyun.cn/
+ * @Author: iflytek
+ * @Data: 2019-12-20
+ *
+ * 本文件包含WebAPI接口数据帧（json信封）序列化类定义及实现
+ * iflytek_envelope将json信封预先序列化为模板，发送每一帧时只需拼接固定片段、写入帧标识status，
+ * 并将音频（或文本）的base64编码直接写入可复用的发送缓冲区，输出与nlohmann::json的dump()逐字节相同
+ */
+
+#ifndef _IFLYTEK_ENVELOPE_HPP
+#define _IFLYTEK_ENVELOPE_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "iflytek_utils.hpp"
+#include "json.hpp"
+
+/**
+ * @brief 预编译的json信封模板
+ * 以status_placeholder和payload_placeholder分别占位帧标识和base64编码的数据，
+ * compile时dump一次并按占位符切分为三段固定片段，之后serialize不再构造json对象
+ * base64字符集及数字都不需要json转义，因此直接写入的结果与dump()相同
+ *
+ * [public]
+ * @func iflytek_envelope 构造函数
+ * @func compile 按json信封生成模板
+ * @func get_length 获得序列化结果的最大长度
+ * @func serialize 序列化一帧数据，写入调用者提供的缓冲区
+ *
+ * [protected]
+ * @func put_status 以十进制写入帧标识
+ * @member segments 按占位符切分的三段固定片段
+ * @member status_first 帧标识是否位于数据之前（json的键按字典序排列）
+ * @member compiled 模板是否已生成
+ */
+class iflytek_envelope
+{
+public:
+    enum
+    {
+        status_placeholder = 2147483647
+    };
+    static const char *payload_placeholder() { return "${payload}"; }
+
+    iflytek_envelope();
+    int compile(const nlohmann::json &envelope);
+    size_t get_length(size_t length) const;
+    size_t serialize(int status, const unsigned char *payload, size_t length, char *buffer) const;
+    size_t serialize(int status, const unsigned char *payload, size_t length, std::string &buffer) const;
+
+protected:
+    static size_t put_status(int status, char *buffer);
+
+private:
+    std::string segments[3];
+    bool status_first;
+    bool compiled;
+};
+
+/**
+ * @brief 构造函数
+ * 需要调用compile生成模板后才能序列化
+ */
+iflytek_envelope::iflytek_envelope()
+    : status_first(false), compiled(false)
+{
+}
+
+/**
+ * @brief 按json信封生成模板
+ * @param envelope json信封，帧标识的值为status_placeholder，数据的值为payload_placeholder()，两者各出现一次
+ * @return 成功时返回0，占位符缺失或重复时返回-1
+ */
+int iflytek_envelope::compile(const nlohmann::json &envelope)
+{
+    std::string text = envelope.dump();
+    std::string status = ":" + std::to_string(status_placeholder);
+    std::string payload = ":\"" + std::string(payload_placeholder()) + "\"";
+
+    size_t status_pos = text.find(status);
+    size_t payload_pos = text.find(payload);
+    if (status_pos == std::string::npos || payload_pos == std::string::npos ||
+        text.find(status, status_pos + 1) != std::string::npos || text.find(payload, payload_pos + 1) != std::string::npos)
+    {
+        fprintf(stderr, "[ERROR] Invalid envelope template: %s\n", text.c_str());
+        this->compiled = false;
+        return -1;
+    }
+
+    // 占位符保留冒号及引号，切分时只去掉占位的值
+    status_pos += 1;
+    payload_pos += 2;
+    size_t status_end = status_pos + status.size() - 1;
+    size_t payload_end = payload_pos + payload.size() - 3;
+
+    this->status_first = status_pos < payload_pos;
+    size_t first_pos = this->status_first ? status_pos : payload_pos;
+    size_t first_end = this->status_first ? status_end : payload_end;
+    size_t second_pos = this->status_first ? payload_pos : status_pos;
+    size_t second_end = this->status_first ? payload_end : status_end;
+
+    this->segments[0] = text.substr(0, first_pos);
+    this->segments[1] = text.substr(first_end, second_pos - first_end);
+    this->segments[2] = text.substr(second_end);
+    this->compiled = true;
+    return 0;
+}
+
+/**
+ * @brief 获得序列化结果的最大长度
+ * @param length 数据长度
+ * @return 序列化结果的最大长度，帧标识按int的最大位数计算
+ */
+size_t iflytek_envelope::get_length(size_t length) const
+{
+    return this->segments[0].size() + this->segments[1].size() + this->segments[2].size() + 11 + get_base64_encode_length(length);
+}
+
+/**
+ * @brief 序列化一帧数据，写入调用者提供的缓冲区
+ * @param status 帧标识
+ * @param payload 数据，写入前进行base64编码
+ * @param length 数据长度
+ * @param buffer 缓冲区，长度需不小于get_length(length)
+ * @return 序列化结果的长度，模板未生成时返回0
+ */
+size_t iflytek_envelope::serialize(int status, const unsigned char *payload, size_t length, char *buffer) const
+{
+    if (!this->compiled)
+    {
+        return 0;
+    }
+
+    char *p = buffer;
+    memcpy(p, this->segments[0].data(), this->segments[0].size());
+    p += this->segments[0].size();
+    p += this->status_first ? put_status(status, p) : get_base64_encode(payload, length, p);
+    memcpy(p, this->segments[1].data(), this->segments[1].size());
+    p += this->segments[1].size();
+    p += this->status_first ? get_base64_encode(payload, length, p) : put_status(status, p);
+    memcpy(p, this->segments[2].data(), this->segments[2].size());
+    p += this->segments[2].size();
+
+    return p - buffer;
+}
+
+/**
+ * @brief 序列化一帧数据，写入可复用的发送缓冲区
+ * 缓冲区的容量在帧之间保持，只在数据变长时重新分配
+ * @param status 帧标识
+ * @param payload 数据，写入前进行base64编码
+ * @param length 数据长度
+ * @param buffer 发送缓冲区，长度被设置为序列化结果的长度
+ * @return 序列化结果的长度，模板未生成时返回0
+ */
+size_t iflytek_envelope::serialize(int status, const unsigned char *payload, size_t length, std::string &buffer) const
+{
+    size_t size = this->get_length(length);
+    if (buffer.size() < size)
+    {
+        buffer.resize(size);
+    }
+    size = this->serialize(status, payload, length, &buffer[0]);
+    buffer.resize(size);
+    return size;
+}
+
+/**
+ * @brief 以十进制写入帧标识
+ * @param status 帧标识
+ * @param buffer 缓冲区，至少11个字节
+ * @return 写入的字节数
+ */
+size_t iflytek_envelope::put_status(int status, char *buffer)
+{
+    // 帧标识通常只有一位
+    if (status >= 0 && status <= 9)
+    {
+        buffer[0] = '0' + status;
+        return 1;
+    }
+
+    char digits[11];
+    size_t count = 0;
+    unsigned int value = status < 0 ? 0u - (unsigned int)status : (unsigned int)status;
+    do
+    {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    size_t length = 0;
+    if (status < 0)
+    {
+        buffer[length++] = '-';
+    }
+    while (count)
+    {
+        buffer[length++] = digits[--count];
+    }
+    return length;
+}
+
+#endif
@@ -3,24 +3,33 @@
  * @Author: iflytek
  * @Data: 2019-1-19
  * 
- * 本文件包含“讯飞开放平台”的WebAPI接口，对opus编码后的音频文件进行ogg封装工具的实现，iflytek_ogg_opus实现过程中采用及参考了如下开源的音频编解码框架:
+ * 本文件包含“讯飞开放平台”的WebAPI接口，对opus编码后的音频文件进行ogg封装及解封装工具的实现，iflytek_ogg_opus实现过程中采用及参考了如下开源的音频编解码框架:
  * 1. opus 1.3.1, http://www.opus-codec.org/
  * 2. libopusenc 0.2.1, https://www.opus-codec.org/release/dev/2018/10/09/libopusenc-0_2_1.html
  * 3. RFC 3533, which defines the ogg transport bitstream and file format, https://wiki.xiph.org/Ogg
  * 4. 待续
  * 
- * 注：本文件仅根据opus的ogg封装格式对opus进行封装，假定一个包作为一段，不考虑对包分割，故opus单个压缩数据应该限制在255字节
+ * 注：本文件仅根据opus的ogg封装格式对opus进行封装，opus包按RFC 3533的lacing规则分段，超过一页的包分割到后续的续包页中
  * 注：如有其他需求，请参考ogg官方文档及libopusenc源码对本文件将进行修改
  */
 #ifndef _IFLYTEK_OGG_OPUS_HPP
 #define _IFLYTEK_OGG_OPUS_HPP
 
 #include <stdio.h>
+#include <algorithm>
 #include <cstring>
 #include <ctime>
+#include <functional>
 #include <random>
+#include <vector>
 
-// 每ogg页最多存放10个段，可以自由设置，最大为255段
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+#include "opus/opus.h"
+
+// 每ogg页默认最多存放25个段，可以通过ogg_flush_policy设置，最大为255段
 #define MAX_SEGMENTS 25
 
 // crc_checksum table
@@ -90,13 +99,17 @@ static const __uint32_t crc_lookup[256] = {
     0xafb010b1, 0xab710d06, 0xa6322bdf, 0xa2f33668,
     0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4};
 
-// ogg页
+// ogg页，页头和数据体保存在调用者提供的同一块缓冲区中
+// 数据体固定从缓冲区的第27 + 255个字节开始，封装时页头被移动到紧挨数据体之前，
+// 封装完成后从header开始的header_length + body_length个字节即为连续存放的完整一页
 typedef struct
 {
-    char header[27 + 255];
+    char *header;
     __uint64_t header_length;
-    char body[255 * 255];
+    char *body;
     __uint64_t body_length;
+    char *buffer;
+    __uint64_t body_capacity;
 } ogg_page;
 
 // ogg逻辑流的状态信息
@@ -129,12 +142,20 @@ typedef struct
     char **comments;
 } opus_comment_header;
 
+// ogg页的输出策略，任一条件满足时输出当前页，值为0表示不限制该条件
+typedef struct
+{
+    int max_latency;  // 每页最多缓存的音频时长（毫秒）
+    int max_segments; // 每页最多存放的段数，最大为255
+    size_t max_bytes; // 每页数据体的最大字节数
+} ogg_flush_policy;
+
 /**
  * @brief 写16位比特
  * @param p 写入的首地址
  * @param val 待写入的16位数据
  */
-void write_uint16(char *p, __uint16_t val)
+inline void write_uint16(char *p, __uint16_t val)
 {
     *p = (val)&0xff;
     *(p + 1) = (val >> 8) & 0xff;
@@ -145,7 +166,7 @@ void write_uint16(char *p, __uint16_t val)
  * @param p 写入的首地址
  * @param val 待写入的32位数据
  */
-void write_uint32(char *p, __uint32_t val)
+inline void write_uint32(char *p, __uint32_t val)
 {
     for (int i = 0; i < 4; i++)
     {
@@ -159,7 +180,7 @@ void write_uint32(char *p, __uint32_t val)
  * @param p 写入的首地址
  * @param val 待写入的64位数据
  */
-void write_uint64(char *p, __uint64_t val)
+inline void write_uint64(char *p, __uint64_t val)
 {
     for (int i = 0; i < 8; i++)
     {
@@ -168,25 +189,68 @@ void write_uint64(char *p, __uint64_t val)
     }
 }
 
+/**
+ * @brief 读16位比特
+ * @param p 读取的首地址
+ * @return 读取的16位数据
+ */
+inline __uint16_t read_uint16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+/**
+ * @brief 读32位比特
+ * @param p 读取的首地址
+ * @return 读取的32位数据
+ */
+inline __uint32_t read_uint32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((__uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief 获得ogg页所需的缓冲区大小
+ * @param body_capacity 数据体的最大字节数，最大为255 * 255
+ * @return 缓冲区大小，包括最长的页头
+ */
+inline size_t get_ogg_page_size(size_t body_capacity)
+{
+    return 27 + 255 + body_capacity;
+}
+
 /**
  * @brief 初始化新的ogg页
- * @param op 待初始化的ogg页结构体
+ * 只清零页头的固定部分，段表和数据体在写入时覆盖
+ * @param op 待初始化的ogg页结构体，需要先调用bind_ogg_page绑定缓冲区
  */
-void init_ogg_page(ogg_page &op)
+inline void init_ogg_page(ogg_page &op)
 {
-    // op.header = new char[27 + 255];
-    // op.body = new char[255 * 255];
-    memset(op.header, 0, (27 + 255));
-    memset(op.body, 0, (255 * 255));
+    op.header = op.buffer;
+    memset(op.header, 0, 27);
     op.header_length = 27;
     op.body_length = 0;
 }
 
+/**
+ * @brief 将ogg页绑定到调用者提供的缓冲区，并初始化该页
+ * @param op ogg页结构体
+ * @param buffer 缓冲区，在ogg页使用期间有效
+ * @param size 缓冲区大小，不小于get_ogg_page_size(0)
+ */
+inline void bind_ogg_page(ogg_page &op, char *buffer, size_t size)
+{
+    op.buffer = buffer;
+    op.body = buffer + 27 + 255;
+    op.body_capacity = size - (27 + 255);
+    init_ogg_page(op);
+}
+
 /**
  * @brief 初始化新的ogg逻辑流
  * @param os 待初始化的ogg逻辑流结构体
  */
-void init_ogg_logic_stream(ogg_logic_stream &os)
+inline void init_ogg_logic_stream(ogg_logic_stream &os)
 {
     // default, the first stream is the begin of (logic) stream
     os.page_flag = 0x02;
@@ -199,12 +263,34 @@ void init_ogg_logic_stream(ogg_logic_stream &os)
     os.page_counter = 0;
 }
 
+/**
+ * @brief 在ogg页的段表中追加一个包（或其一部分）的lacing值
+ * 长度为L的包由L / 255个255字节的段和一个L % 255字节的结束段（可以为0字节）组成，
+ * 包在该页未结束时只写入255字节的段，剩余部分放在下一页（续包页）
+ * @param op ogg页
+ * @param length 该页存放的包数据长度，包在该页未结束时应为255的整数倍
+ * @param packet_end 包是否在该页结束
+ */
+inline void ogg_page_put_lacing(ogg_page &op, size_t length, bool packet_end)
+{
+    __uint8_t filled_segments = __uint8_t(op.header[26]);
+    size_t segments = length / 255;
+    memset(op.header + 27 + filled_segments, 255, segments);
+    if (packet_end)
+    {
+        op.header[27 + filled_segments + segments] = length % 255;
+        segments++;
+    }
+    op.header[26] = filled_segments + segments;
+    op.header_length += segments;
+}
+
 /**
  * @brief 将opus的id头放入单独的一个页
  * @param op ogg页
  * @param id_header opus的id头信息
  */
-void ogg_page_put_id_header(ogg_page &op, const opus_id_header id_header)
+inline void ogg_page_put_id_header(ogg_page &op, const opus_id_header id_header)
 {
     /* page header */
     // segment_number
@@ -245,15 +331,8 @@ void ogg_page_put_id_header(ogg_page &op, const opus_id_header id_header)
  * @param op ogg页
  * @param comment_header opus的comment头信息
  */
-void ogg_page_put_comment_header(ogg_page &op, const opus_comment_header comment_header)
+inline void ogg_page_put_comment_header(ogg_page &op, const opus_comment_header comment_header)
 {
-    /* page header */
-    // segment_number
-    op.header[26] = 1;
-    // segment tabel, assign in later
-    // op.header[27] = op.body_length;
-    op.header_length++;
-
     /* page body */
     int pos = 0;
     // magic signature
@@ -268,7 +347,7 @@ void ogg_page_put_comment_header(ogg_page &op, const opus_comment_header comment
     // comment_number
     write_uint32(op.body + pos, comment_header.comment_number);
     pos += 4;
-    for (int i = 0; i < comment_header.comment_number; i++)
+    for (__uint32_t i = 0; i < comment_header.comment_number; i++)
     {
         int comment_length = strlen(comment_header.comments[i]);
         write_uint32(op.body + pos, comment_length);
@@ -277,48 +356,230 @@ void ogg_page_put_comment_header(ogg_page &op, const opus_comment_header comment
         pos += comment_length;
     }
 
+    /* page header */
+    // segment number and segment tabel, the comment header may be longer than one segment
+    ogg_page_put_lacing(op, pos, true);
     // update body_length of page
     op.body_length += pos;
-    // assign segment tabel
-    op.header[27] = op.body_length;
 }
 
 /**
  * @brief 将opus编码数据放入ogg页
+ * 该页的段数或字节数放不下剩余数据时，只放入尽可能多的255字节的段，剩余数据需要在下一页继续放入
  * @parma os ogg逻辑流
  * @param op ogg页
  * @param data opus编码数据
  * @param data_length opus编码数据长度
- * @retrun 成功时返回0，该页存放的段大于最大段长时返回错误-1
+ * @param offset 已放入之前页的数据长度，返回时更新为已放入的数据长度
+ * @param max_segments 该页最多存放的段数，最大为255
+ * @param max_bytes 该页数据体最多存放的字节数，不超过body_capacity
+ * @param samples 该包的音频采样数（48kHz），包在该页结束时累加到granule position
+ * @retrun 包在该页结束时返回1，剩余数据需要在下一页继续放入时返回0
  */
-int ogg_page_put_packet(ogg_logic_stream &os, ogg_page &op, const char *data, const __uint8_t data_length)
+inline int ogg_page_put_packet(ogg_logic_stream &os, ogg_page &op, const char *data, size_t data_length, size_t &offset,
+                        int max_segments, size_t max_bytes, __uint32_t samples)
 {
-    __uint8_t filled_segments = __uint8_t(op.header[26]);
-    if (filled_segments >= MAX_SEGMENTS)
-        return -1;
-    // add a new segment
-    op.header[26] = ++filled_segments;
-    op.header[26 + filled_segments] = data_length;
-    memcpy(op.body + op.body_length, data, data_length);
-
-    op.header_length++;
-    op.body_length += data_length;
+    size_t free_segments = max_segments - __uint8_t(op.header[26]);
+    size_t free_bytes = max_bytes - op.body_length;
+    size_t length = data_length - offset;
+    bool packet_end = length / 255 + 1 <= free_segments && length <= free_bytes;
+    if (!packet_end)
+    {
+        // only complete segments of 255 bytes, the packet continues in the next page
+        length = std::min(std::min(length / 255, free_segments), free_bytes / 255) * 255;
+    }
+    ogg_page_put_lacing(op, length, packet_end);
+    memcpy(op.body + op.body_length, data + offset, length);
+    op.body_length += length;
+    offset += length;
+    if (!packet_end)
+    {
+        return 0;
+    }
 
     // update the logic stream state
     // The duration of an Opus packet may be any multiple of 2.5 ms, up to a maximum of 120 ms.
     // This duration is encoded in the TOC sequence at the beginning of each packet.
     // The number of samples returned by a decoder corresponds to this duration exactly, even for the first few packets.
     // For example, a 20 ms packet fed to a decoder running at 48 kHz will always return 960 samples.
-    os.granule_position += 960;
+    os.granule_position += samples;
 
-    return 0;
+    return 1;
+}
+
+/**
+ * @brief 逐字节查表更新ogg crc（多项式0x04c11db7，高位在前，初值0，不取反）
+ * @param crc 当前crc寄存器的值
+ * @param data 数据
+ * @param length 数据长度
+ * @return 更新后的crc寄存器的值
+ */
+inline __uint32_t ogg_crc_update_bytewise(__uint32_t crc, const unsigned char *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        crc = (crc << 8) ^ crc_lookup[((crc >> 24) & 0xff) ^ data[i]];
+    return crc;
+}
+
+/**
+ * @brief 计算x^n mod P，P为ogg crc的生成多项式
+ * @param n 幂次
+ * @return 余式，最高位对应x^31
+ */
+inline __uint32_t ogg_crc_xpow(unsigned int n)
+{
+    __uint32_t r = 1;
+    while (n--)
+        r = (r << 1) ^ ((r & 0x80000000) ? 0x04c11db7 : 0);
+    return r;
+}
+
+// slicing-by-8查找表，table[k][b]为字节b后接k个0字节的crc，table[0]即crc_lookup
+struct ogg_crc_slice_table
+{
+    __uint32_t table[8][256];
+
+    ogg_crc_slice_table()
+    {
+        for (int b = 0; b < 256; b++)
+        {
+            table[0][b] = crc_lookup[b];
+            for (int k = 1; k < 8; k++)
+                table[k][b] = (table[k - 1][b] << 8) ^ crc_lookup[table[k - 1][b] >> 24];
+        }
+    }
+};
+
+/**
+ * @brief 以slicing-by-8方式更新ogg crc，每次查8张表处理8个字节，结果与逐字节查表相同
+ * @param crc 当前crc寄存器的值
+ * @param data 数据
+ * @param length 数据长度
+ * @return 更新后的crc寄存器的值
+ */
+inline __uint32_t ogg_crc_update_slice8(__uint32_t crc, const unsigned char *data, size_t length)
+{
+    static const ogg_crc_slice_table slice;
+    const __uint32_t(*t)[256] = slice.table;
+
+    while (length >= 8)
+    {
+        // crc寄存器与前4个字节异或，高位在前
+        __uint32_t hi = crc ^ ((__uint32_t)data[0] << 24 | (__uint32_t)data[1] << 16 | (__uint32_t)data[2] << 8 | data[3]);
+        __uint32_t lo = (__uint32_t)data[4] << 24 | (__uint32_t)data[5] << 16 | (__uint32_t)data[6] << 8 | data[7];
+        crc = t[7][hi >> 24] ^ t[6][(hi >> 16) & 0xff] ^ t[5][(hi >> 8) & 0xff] ^ t[4][hi & 0xff] ^
+              t[3][lo >> 24] ^ t[2][(lo >> 16) & 0xff] ^ t[1][(lo >> 8) & 0xff] ^ t[0][lo & 0xff];
+        data += 8;
+        length -= 8;
+    }
+    return ogg_crc_update_bytewise(crc, data, length);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IFLYTEK_OGG_CRC_CLMUL
+
+// 无进位乘法折叠所用的常数，fold_1为相邻16字节、fold_4为相隔64字节的x^(d+64) mod P（高64位）和x^d mod P（低64位）
+struct ogg_crc_fold_constants
+{
+    __uint64_t fold_1[2], fold_4[2];
+
+    ogg_crc_fold_constants()
+    {
+        fold_1[0] = ogg_crc_xpow(128);
+        fold_1[1] = ogg_crc_xpow(128 + 64);
+        fold_4[0] = ogg_crc_xpow(512);
+        fold_4[1] = ogg_crc_xpow(512 + 64);
+    }
+};
+
+/**
+ * @brief 将128位累加值A乘以x^d并模P折叠回128位以内：A_hi * (x^(d+64) mod P) ^ A_lo * (x^d mod P)
+ */
+__attribute__((target("pclmul,ssse3"))) inline __m128i ogg_crc_fold(__m128i a, __m128i k)
+{
+    return _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x00), _mm_clmulepi64_si128(a, k, 0x11));
+}
+
+/**
+ * @brief 以无进位乘法（PCLMULQDQ）折叠的方式更新ogg crc，结果与逐字节查表相同
+ * 数据按16字节大端载入为128位多项式，4路并行每次折叠64字节，合并为1路后把余下的128位累加值
+ * 按大端写回16个字节，与不足16字节的尾部一起查表得到crc；crc寄存器的初值异或到第一个块的最高32位
+ * @param crc 当前crc寄存器的值
+ * @param data 数据
+ * @param length 数据长度
+ * @return 更新后的crc寄存器的值
+ */
+__attribute__((target("pclmul,ssse3"))) inline __uint32_t ogg_crc_update_clmul(__uint32_t crc, const unsigned char *data, size_t length)
+{
+    if (length < 64)
+    {
+        return ogg_crc_update_slice8(crc, data, length);
+    }
+
+    static const ogg_crc_fold_constants constants;
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m128i k1 = _mm_loadu_si128((const __m128i *)constants.fold_1);
+    const __m128i k4 = _mm_loadu_si128((const __m128i *)constants.fold_4);
+
+    __m128i a0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), reverse);
+    __m128i a1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), reverse);
+    __m128i a2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), reverse);
+    __m128i a3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), reverse);
+    a0 = _mm_xor_si128(a0, _mm_set_epi32((int)crc, 0, 0, 0));
+    data += 64;
+    length -= 64;
+
+    while (length >= 64)
+    {
+        a0 = _mm_xor_si128(ogg_crc_fold(a0, k4), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), reverse));
+        a1 = _mm_xor_si128(ogg_crc_fold(a1, k4), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), reverse));
+        a2 = _mm_xor_si128(ogg_crc_fold(a2, k4), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), reverse));
+        a3 = _mm_xor_si128(ogg_crc_fold(a3, k4), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), reverse));
+        data += 64;
+        length -= 64;
+    }
+
+    __m128i a = _mm_xor_si128(ogg_crc_fold(a0, k1), a1);
+    a = _mm_xor_si128(ogg_crc_fold(a, k1), a2);
+    a = _mm_xor_si128(ogg_crc_fold(a, k1), a3);
+    while (length >= 16)
+    {
+        a = _mm_xor_si128(ogg_crc_fold(a, k1), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), reverse));
+        data += 16;
+        length -= 16;
+    }
+
+    unsigned char block[16];
+    _mm_storeu_si128((__m128i *)block, _mm_shuffle_epi8(a, reverse));
+    crc = ogg_crc_update_slice8(0, block, sizeof(block));
+    return ogg_crc_update_slice8(crc, data, length);
+}
+#endif
+
+/**
+ * @brief 更新ogg crc，运行时按CPU支持的指令集选择实现
+ * @param crc 当前crc寄存器的值
+ * @param data 数据
+ * @param length 数据长度
+ * @return 更新后的crc寄存器的值
+ */
+inline __uint32_t ogg_crc_update(__uint32_t crc, const unsigned char *data, size_t length)
+{
+#ifdef IFLYTEK_OGG_CRC_CLMUL
+    static const bool clmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+    if (clmul)
+    {
+        return ogg_crc_update_clmul(crc, data, length);
+    }
+#endif
+    return ogg_crc_update_slice8(crc, data, length);
 }
 
 /**
  * @brief 对ogg页的头部和数据体进行crc校验
  * @parma op ogg页
  */
-void ogg_page_crc_checksum(ogg_page &op)
+inline void ogg_page_crc_checksum(ogg_page &op)
 {
     __uint32_t crc_reg = 0;
 
@@ -329,10 +590,15 @@ void ogg_page_crc_checksum(ogg_page &op)
     op.header[25] = 0;
 
     // must be unsigned char, error if char
-    for (int i = 0; i < op.header_length; i++)
-        crc_reg = (crc_reg << 8) ^ crc_lookup[((crc_reg >> 24) & 0xff) ^ (unsigned char)op.header[i]];
-    for (int i = 0; i < op.body_length; i++)
-        crc_reg = (crc_reg << 8) ^ crc_lookup[((crc_reg >> 24) & 0xff) ^ (unsigned char)op.body[i]];
+    if (op.header + op.header_length == op.body)
+    {
+        crc_reg = ogg_crc_update(crc_reg, (const unsigned char *)op.header, op.header_length + op.body_length);
+    }
+    else
+    {
+        crc_reg = ogg_crc_update(crc_reg, (const unsigned char *)op.header, op.header_length);
+        crc_reg = ogg_crc_update(crc_reg, (const unsigned char *)op.body, op.body_length);
+    }
 
     op.header[22] = (unsigned char)(crc_reg & 0xff);
     op.header[23] = (unsigned char)((crc_reg >> 8) & 0xff);
@@ -345,16 +611,29 @@ void ogg_page_crc_checksum(ogg_page &op)
  * @param os ogg逻辑流
  * @param op ogg页
  */
-void ogg_page_encapsulate(ogg_logic_stream &os, ogg_page &op)
+inline void ogg_page_encapsulate(ogg_logic_stream &os, ogg_page &op)
 {
+    // move the header right in front of the body, so that the page is contiguous
+    char *header = op.body - op.header_length;
+    if (header != op.header)
+    {
+        memmove(header, op.header, op.header_length);
+        op.header = header;
+    }
     // 32 bits, capture pattern
     memcpy(op.header, "OggS", 4);
     // 8 bits, version
     op.header[4] = 0x00;
     // 8 bits, header type. continued page? first page? last page?
     op.header[5] = os.page_flag;
-    // 64 bits, PCM position
-    write_uint64(op.header + 6, os.granule_position);
+    // 64 bits, PCM position, -1 when no packet finishes on this page
+    __uint8_t segments = __uint8_t(op.header[26]);
+    bool packet_end = segments == 0;
+    for (int i = segments - 1; i >= 0 && !packet_end; i--)
+    {
+        packet_end = __uint8_t(op.header[27 + i]) < 255;
+    }
+    write_uint64(op.header + 6, packet_end ? os.granule_position : ~__uint64_t(0));
     // 32 bits, serial number
     write_uint32(op.header + 14, os.serial_number);
     // 32 bits, page counter
@@ -367,6 +646,540 @@ void ogg_page_encapsulate(ogg_logic_stream &os, ogg_page &op)
 
     // update ogg_logic_stream data
     os.page_counter++;
+    // only the first page begins the stream, the next page continues the packet if the last segment is 255 bytes
+    os.page_flag &= ~0x03;
+    if (segments > 0 && __uint8_t(op.header[26 + segments]) == 255)
+    {
+        os.page_flag |= 0x01;
+    }
+}
+
+/**
+ * @brief 流式ogg-opus封装类
+ * 按ogg_flush_policy把opus包封装进调用者提供的缓冲区，页满足输出条件时完成封装并交给回调函数，
+ * 页头紧挨数据体连续存放，回调函数可以直接使用整页而无需拼接；回调函数返回后该页被清空并用于存放后续的包，
+ * 最大缓存时长决定了音频在封装器中停留的最长时间
+ *
+ * [public]
+ * @func get_buffer_size 获得按输出策略所需的缓冲区大小
+ * @func ogg_opus_muxer 构造函数
+ * @func put_header 输出opus的id头页和comment头页
+ * @func put_packet 放入一个opus包，满足输出条件时输出当前页
+ * @func flush 输出当前页（如果非空）
+ * @func finish 输出带流结束标志的最后一页
+ * @func get_buffered_ms 获得当前页缓存的音频时长
+ *
+ * [protected]
+ * @func emit 完成当前页的封装并交给回调函数
+ * @func get_max_bytes 获得每页数据体的最大字节数
+ * @member op 绑定到调用者提供的缓冲区的ogg页
+ * @member os ogg逻辑流
+ * @member policy 页的输出策略
+ * @member on_page 页的回调函数，返回false时停止封装
+ * @member page_samples 当前页缓存的音频采样数（48kHz）
+ */
+class ogg_opus_muxer
+{
+public:
+    typedef std::function<bool(const ogg_page &op)> page_handler;
+
+    static size_t get_buffer_size(const ogg_flush_policy &policy);
+    ogg_opus_muxer(char *buffer, size_t size, const ogg_flush_policy &policy, page_handler on_page);
+    int put_header(const opus_id_header &id_header, const opus_comment_header &comment_header);
+    int put_packet(const char *data, size_t data_length);
+    int flush();
+    int finish();
+    int get_buffered_ms() const;
+
+protected:
+    int emit();
+    size_t get_max_bytes() const;
+
+private:
+    ogg_page op;
+    ogg_logic_stream os;
+    ogg_flush_policy policy;
+    page_handler on_page;
+    __uint64_t page_samples;
+};
+
+/**
+ * @brief 获得按输出策略所需的缓冲区大小
+ * 数据体最多为max_bytes字节，或者max_segments个255字节的段
+ * @param policy 页的输出策略
+ * @return 缓冲区大小
+ */
+inline size_t ogg_opus_muxer::get_buffer_size(const ogg_flush_policy &policy)
+{
+    size_t segments = policy.max_segments <= 0 || policy.max_segments > 255 ? 255 : policy.max_segments;
+    size_t body_capacity = segments * 255;
+    if (policy.max_bytes > 0 && policy.max_bytes < body_capacity)
+    {
+        body_capacity = policy.max_bytes;
+    }
+    return get_ogg_page_size(body_capacity);
+}
+
+/**
+ * @brief 构造函数
+ * @param buffer 调用者提供的页缓冲区，封装器使用期间不能用于其他用途
+ * @param size 缓冲区大小，一般为get_buffer_size(policy)
+ * @param policy 页的输出策略，段数为0或超过255时按255处理
+ * @param on_page 页的回调函数，整页在回调期间有效
+ */
+inline ogg_opus_muxer::ogg_opus_muxer(char *buffer, size_t size, const ogg_flush_policy &policy, page_handler on_page)
+    : policy(policy), on_page(on_page), page_samples(0)
+{
+    if (this->policy.max_segments <= 0 || this->policy.max_segments > 255)
+    {
+        this->policy.max_segments = 255;
+    }
+    init_ogg_logic_stream(this->os);
+    bind_ogg_page(this->op, buffer, size);
+}
+
+/**
+ * @brief 输出opus的id头页和comment头页，两个头各自单独成页
+ * @param id_header opus的id头信息
+ * @param comment_header opus的comment头信息
+ * @return 成功时返回0，comment头超过缓冲区或回调函数返回false时返回-1
+ */
+inline int ogg_opus_muxer::put_header(const opus_id_header &id_header, const opus_comment_header &comment_header)
+{
+    size_t comment_length = 8 + 4 + comment_header.encoder_info_length + 4;
+    for (__uint32_t i = 0; i < comment_header.comment_number; i++)
+    {
+        comment_length += 4 + strlen(comment_header.comments[i]);
+    }
+    if (comment_length / 255 + 1 > 255 || comment_length > this->op.body_capacity)
+    {
+        fprintf(stderr, "[ERROR] Opus comment header is too long (%d bytes)\n", (int)comment_length);
+        return -1;
+    }
+
+    ogg_page_put_id_header(this->op, id_header);
+    if (this->emit() == -1)
+    {
+        return -1;
+    }
+    ogg_page_put_comment_header(this->op, comment_header);
+    return this->emit();
+}
+
+/**
+ * @brief 放入一个opus包
+ * 当前页放不下该包（段数、字节数或缓冲区超限）时先输出当前页，空页也放不下时将该包分割到连续的多个页中，
+ * 放入后缓存时长达到上限时输出当前页；包的时长按TOC字节计算，可以为2.5ms到120ms
+ * @param data opus包
+ * @param data_length opus包长度
+ * @return 成功时返回0，包无法解析、回调函数返回false或每页放不下一个255字节的段时返回-1
+ */
+inline int ogg_opus_muxer::put_packet(const char *data, size_t data_length)
+{
+    // granule position以48kHz计数，与编码时的采样率无关
+    int samples = opus_packet_get_nb_samples((const unsigned char *)data, data_length, 48000);
+    if (samples < 0)
+    {
+        fprintf(stderr, "[ERROR] Invalid opus packet (%d bytes): %s\n", (int)data_length, opus_strerror(samples));
+        return -1;
+    }
+
+    size_t max_bytes = this->get_max_bytes();
+    int filled_segments = __uint8_t(this->op.header[26]);
+    bool full = filled_segments + data_length / 255 + 1 > (size_t)this->policy.max_segments ||
+                this->op.body_length + data_length > max_bytes;
+    if (filled_segments > 0 && full && this->emit() == -1)
+    {
+        return -1;
+    }
+
+    size_t offset = 0;
+    while (ogg_page_put_packet(this->os, this->op, data, data_length, offset, this->policy.max_segments, max_bytes, samples) == 0)
+    {
+        if (__uint8_t(this->op.header[26]) == 0)
+        {
+            fprintf(stderr, "[ERROR] Opus packet (%d bytes) exceeds the ogg page buffer\n", (int)data_length);
+            return -1;
+        }
+        // 没有包在该页结束，该页的granule position为-1
+        if (this->emit() == -1)
+        {
+            return -1;
+        }
+    }
+    this->page_samples += samples;
+
+    if (this->policy.max_latency > 0 && this->get_buffered_ms() >= this->policy.max_latency)
+    {
+        return this->emit();
+    }
+    return 0;
+}
+
+/**
+ * @brief 输出当前页，当前页没有数据时不输出
+ * @return 成功时返回0，回调函数返回false时返回-1
+ */
+inline int ogg_opus_muxer::flush()
+{
+    if (__uint8_t(this->op.header[26]) == 0)
+    {
+        return 0;
+    }
+    return this->emit();
+}
+
+/**
+ * @brief 输出带流结束标志的最后一页，当前页没有数据时输出空页
+ * @return 成功时返回0，回调函数返回false时返回-1
+ */
+inline int ogg_opus_muxer::finish()
+{
+    this->os.page_flag |= 0x04;
+    return this->emit();
+}
+
+/**
+ * @brief 获得当前页缓存的音频时长
+ * @return 当前页缓存的音频时长（毫秒）
+ */
+inline int ogg_opus_muxer::get_buffered_ms() const
+{
+    return this->page_samples / 48;
+}
+
+/**
+ * @brief 完成当前页的封装并交给回调函数，之后清空当前页
+ * @return 成功时返回0，回调函数返回false时返回-1
+ */
+inline int ogg_opus_muxer::emit()
+{
+    ogg_page_encapsulate(this->os, this->op);
+    bool ok = this->on_page(this->op);
+
+    init_ogg_page(this->op);
+    this->page_samples = 0;
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief 获得每页数据体的最大字节数
+ * @return max_bytes和缓冲区容量中较小的一个
+ */
+inline size_t ogg_opus_muxer::get_max_bytes() const
+{
+    if (this->policy.max_bytes > 0 && this->policy.max_bytes < this->op.body_capacity)
+    {
+        return this->policy.max_bytes;
+    }
+    return this->op.body_capacity;
+}
+
+/**
+ * @brief 流式ogg-opus解封装类
+ * 数据可以按任意长度分段输入（例如每条websocket消息），每凑齐一页即校验crc并取出其中结束的包交给回调函数；
+ * 完整位于输入数据中的页直接在输入数据上解析，只有跨越两次输入的页和跨越多页的包才被复制，
+ * 前两个包（opus的id头和comment头）由解封装器解析，之后的音频包交给回调函数，只处理第一个逻辑流
+ *
+ * [public]
+ * @func ogg_opus_demuxer 构造函数
+ * @func demux 输入一段数据，取出其中所有完整页中的包
+ * @func get_pending_length 获得保存到下一次输入的不完整页及不完整包的字节数
+ * @func get_id_header 获得opus的id头信息
+ * @func is_finished 是否已收到带流结束标志的页
+ *
+ * [protected]
+ * @func get_page_length 按已有的数据获得一页的长度
+ * @func put_page 校验并解析一页
+ * @func emit 处理一个完整的包
+ * @member pending 不完整的页
+ * @member packet 跨越多页的不完整的包
+ * @member on_packet 音频包的回调函数，返回false时停止解封装
+ * @member id_header opus的id头信息
+ * @member packet_count 已取出的包数，包括两个头
+ * @member serial_number 逻辑流的序列号
+ * @member page_counter 下一页的页序号
+ * @member started 是否已收到带流开始标志的页
+ * @member skip 页序号不连续时丢弃续包页开头的不完整包
+ * @member finished 是否已收到带流结束标志的页
+ */
+class ogg_opus_demuxer
+{
+public:
+    typedef std::function<bool(const unsigned char *packet, size_t packet_length)> packet_handler;
+
+    ogg_opus_demuxer(packet_handler on_packet);
+    int demux(const unsigned char *data, size_t length);
+    size_t get_pending_length() const;
+    const opus_id_header &get_id_header() const;
+    bool is_finished() const;
+
+protected:
+    static size_t get_page_length(const unsigned char *page, size_t available);
+    int put_page(const unsigned char *page, size_t length);
+    int emit(const unsigned char *packet, size_t packet_length);
+
+private:
+    std::vector<unsigned char> pending;
+    std::vector<unsigned char> packet;
+    packet_handler on_packet;
+    opus_id_header id_header;
+    __uint64_t packet_count;
+    __uint32_t serial_number;
+    __uint32_t page_counter;
+    bool started, skip, finished;
+};
+
+/**
+ * @brief 构造函数
+ * @param on_packet 音频包的回调函数，包的数据只在回调期间有效
+ */
+inline ogg_opus_demuxer::ogg_opus_demuxer(packet_handler on_packet)
+    : on_packet(on_packet), id_header(), packet_count(0), serial_number(0), page_counter(0),
+      started(false), skip(false), finished(false)
+{
+}
+
+/**
+ * @brief 输入一段数据，取出其中所有完整页中的包
+ * 上一次输入剩余的不完整页先与本次数据拼接，之后的完整页直接在输入数据上解析，不复制
+ * @param data ogg数据
+ * @param length 数据长度
+ * @return 成功时返回本次交给回调函数的音频包数，页或头无效、crc校验失败或回调函数返回false时返回-1
+ */
+inline int ogg_opus_demuxer::demux(const unsigned char *data, size_t length)
+{
+    int count = 0, n;
+    const unsigned char *end = data + length;
+
+    // 补全上一次输入剩余的不完整页
+    if (!this->pending.empty())
+    {
+        size_t need = get_page_length(this->pending.data(), this->pending.size());
+        while (this->pending.size() < need && data != end)
+        {
+            size_t copy = std::min(need - this->pending.size(), (size_t)(end - data));
+            this->pending.insert(this->pending.end(), data, data + copy);
+            data += copy;
+            need = get_page_length(this->pending.data(), this->pending.size());
+        }
+        if (this->pending.size() < need)
+        {
+            return 0;
+        }
+
+        if ((n = this->put_page(this->pending.data(), need)) == -1)
+        {
+            return -1;
+        }
+        this->pending.clear();
+        count += n;
+    }
+
+    // 直接解析输入数据中的完整页
+    while (data != end)
+    {
+        size_t page_length = get_page_length(data, end - data);
+        if ((size_t)(end - data) < page_length)
+        {
+            break;
+        }
+        if ((n = this->put_page(data, page_length)) == -1)
+        {
+            return -1;
+        }
+        data += page_length;
+        count += n;
+    }
+
+    // 保存不完整的页
+    this->pending.insert(this->pending.end(), data, end);
+    return count;
+}
+
+/**
+ * @brief 获得保存到下一次输入的不完整页及不完整包的字节数
+ * @return 不完整页及不完整包的字节数，数据流结束时不为0说明最后一页被截断
+ */
+inline size_t ogg_opus_demuxer::get_pending_length() const
+{
+    return this->pending.size() + this->packet.size();
+}
+
+/**
+ * @brief 获得opus的id头信息
+ * @return opus的id头信息，在取出第一个包之前各字段为0
+ */
+inline const opus_id_header &ogg_opus_demuxer::get_id_header() const
+{
+    return this->id_header;
+}
+
+/**
+ * @brief 是否已收到带流结束标志的页
+ * @return 已收到时返回true
+ */
+inline bool ogg_opus_demuxer::is_finished() const
+{
+    return this->finished;
+}
+
+/**
+ * @brief 按已有的数据获得一页的长度
+ * @param page 页的起始地址
+ * @param available 已有的字节数
+ * @return 已有数据包含整个页头时返回整页的长度，否则返回还需凑齐的页头（或段表）长度
+ */
+inline size_t ogg_opus_demuxer::get_page_length(const unsigned char *page, size_t available)
+{
+    if (available < 27)
+    {
+        return 27;
+    }
+    size_t header_length = 27 + page[26];
+    if (available < header_length)
+    {
+        return header_length;
+    }
+    size_t body_length = 0;
+    for (size_t i = 27; i < header_length; i++)
+    {
+        body_length += page[i];
+    }
+    return header_length + body_length;
+}
+
+/**
+ * @brief 校验并解析一页，结束于该页的包交给emit处理，该页最后不完整的包保存到packet
+ * 第一个逻辑流之外的页被忽略，页序号不连续时丢弃跨页的不完整包
+ * @param page 完整的一页
+ * @param length 页的长度
+ * @return 成功时返回该页交给回调函数的音频包数，失败时返回-1
+ */
+inline int ogg_opus_demuxer::put_page(const unsigned char *page, size_t length)
+{
+    if (memcmp(page, "OggS", 4) != 0 || page[4] != 0x00)
+    {
+        fprintf(stderr, "[ERROR] Invalid ogg page\n");
+        return -1;
+    }
+
+    // crc checksum, the checksum field is taken as zero
+    static const unsigned char zero[4] = {0, 0, 0, 0};
+    __uint32_t crc_reg = ogg_crc_update(0, page, 22);
+    crc_reg = ogg_crc_update(crc_reg, zero, 4);
+    crc_reg = ogg_crc_update(crc_reg, page + 26, length - 26);
+    if (crc_reg != read_uint32(page + 22))
+    {
+        fprintf(stderr, "[ERROR] Ogg page %u: crc checksum mismatch\n", read_uint32(page + 18));
+        return -1;
+    }
+
+    __uint8_t page_flag = page[5];
+    __uint32_t serial_number = read_uint32(page + 14);
+    __uint32_t page_counter = read_uint32(page + 18);
+    if (!this->started && (page_flag & 0x02))
+    {
+        this->started = true;
+        this->serial_number = serial_number;
+        this->page_counter = page_counter;
+    }
+    if (!this->started || serial_number != this->serial_number)
+    {
+        return 0;
+    }
+
+    // a lost page breaks the packet which spans it
+    if (page_counter != this->page_counter || !(page_flag & 0x01))
+    {
+        this->packet.clear();
+    }
+    this->skip = (page_flag & 0x01) && this->packet.empty();
+    this->page_counter = page_counter + 1;
+
+    int count = 0, n;
+    int segments = page[26];
+    const unsigned char *start = page + 27 + segments;
+    const unsigned char *body = start;
+    for (int i = 0; i < segments; i++)
+    {
+        body += page[27 + i];
+        if (page[27 + i] == 255)
+        {
+            continue;
+        }
+
+        // a packet ends on this page
+        if (this->skip)
+        {
+            this->skip = false;
+        }
+        else if (this->packet.empty())
+        {
+            if ((n = this->emit(start, body - start)) == -1)
+            {
+                return -1;
+            }
+            count += n;
+        }
+        else
+        {
+            this->packet.insert(this->packet.end(), start, body);
+            if ((n = this->emit(this->packet.data(), this->packet.size())) == -1)
+            {
+                return -1;
+            }
+            this->packet.clear();
+            count += n;
+        }
+        start = body;
+    }
+    if (start != body && !this->skip)
+    {
+        this->packet.insert(this->packet.end(), start, body);
+    }
+
+    if (page_flag & 0x04)
+    {
+        this->finished = true;
+    }
+    return count;
+}
+
+/**
+ * @brief 处理一个完整的包，第一个包解析为opus的id头，第二个包为opus的comment头，之后的音频包交给回调函数
+ * @param packet 完整的包
+ * @param packet_length 包的长度
+ * @return 音频包交给回调函数时返回1，头返回0，头无效或回调函数返回false时返回-1
+ */
+inline int ogg_opus_demuxer::emit(const unsigned char *packet, size_t packet_length)
+{
+    this->packet_count++;
+    if (this->packet_count == 1)
+    {
+        if (packet_length < 19 || memcmp(packet, "OpusHead", 8) != 0)
+        {
+            fprintf(stderr, "[ERROR] Invalid opus id header\n");
+            return -1;
+        }
+        this->id_header.version = packet[8];
+        this->id_header.channel = packet[9];
+        this->id_header.pre_skip = read_uint16(packet + 10);
+        this->id_header.sample_rate = read_uint32(packet + 12);
+        this->id_header.gain = read_uint16(packet + 16);
+        this->id_header.channel_mapping_family = packet[18];
+        return 0;
+    }
+    if (this->packet_count == 2)
+    {
+        if (packet_length < 8 || memcmp(packet, "OpusTags", 8) != 0)
+        {
+            fprintf(stderr, "[ERROR] Invalid opus comment header\n");
+            return -1;
+        }
+        return 0;
+    }
+    return this->on_packet(packet, packet_length) ? 1 : -1;
 }
 
 /**
@@ -374,7 +1187,7 @@ void ogg_page_encapsulate(ogg_logic_stream &os, ogg_page &op)
  * @param src opus压缩数据文件路径（16kHz, 16bit/sample, 1channel）
  * @param dest ogg文件保存路径
  */
-void ogg_opus_example(char *src, char *dest)
+inline void ogg_opus_example(char *src, char *dest)
 {
     FILE *fin = fopen(src, "rb");
     if (NULL == fin)
@@ -384,36 +1197,27 @@ void ogg_opus_example(char *src, char *dest)
     }
     FILE *fout = fopen(dest, "wb");
 
-    ogg_logic_stream os;
-    ogg_page op;
-    init_ogg_logic_stream(os);
-    // init_ogg_page(op);
+    // 每页最多缓存100ms的音频，页头与数据体连续存放，一次写入整页
+    ogg_flush_policy policy{100, MAX_SEGMENTS, 0};
+    size_t buffer_size = ogg_opus_muxer::get_buffer_size(policy);
+    char *buffer = new char[buffer_size];
+    ogg_opus_muxer muxer(buffer, buffer_size, policy, [fout](const ogg_page &op) {
+        fwrite(op.header, 1, op.header_length + op.body_length, fout);
+        return true;
+    });
 
-    // send page of opushead
-    init_ogg_page(op);
+    // send page of opushead and opustags
     opus_id_header id_header{1, 1, 312, 16000, 0, 0};
-    ogg_page_put_id_header(op, id_header);
-    ogg_page_encapsulate(os, op);
-    fwrite(op.header, 1, op.header_length, fout);
-    fwrite(op.body, 1, op.body_length, fout);
-    os.page_flag = 0x00;
-
-    // send page of opustags
-    init_ogg_page(op);
     char *encoder_info = (char *)"libopus 1.3.1";
     char *comments[] = {
         (char *)"ARTIST=iflytek",
         (char *)"TITLE=zghong"};
     opus_comment_header comment_header{(__uint32_t)strlen(encoder_info), encoder_info, 2, comments};
-    ogg_page_put_comment_header(op, comment_header);
-    ogg_page_encapsulate(os, op);
-    fwrite(op.header, 1, op.header_length, fout);
-    fwrite(op.body, 1, op.body_length, fout);
+    muxer.put_header(id_header, comment_header);
 
     // send page of data
     char opus[60];
     int size;
-    init_ogg_page(op);
     while (!feof(fin))
     {
         // 60 Bytes, one frame
@@ -421,24 +1225,84 @@ void ogg_opus_example(char *src, char *dest)
         {
             break;
         }
-        if (ogg_page_put_packet(os, op, opus, size) == 0)
+        muxer.put_packet(opus, size);
+    }
+    muxer.finish();
+    delete[] buffer;
+    fclose(fin);
+    fclose(fout);
+}
+
+/**
+ * @brief 对ogg-opus文件解封装并解码示例，可用于离线回放抓取的上传数据
+ * @param src ogg文件路径
+ * @param dest 解码得到的pcm文件保存路径（16bit/sample，采样率为id头中的原始采样率）
+ */
+inline void ogg_opus_demux_example(char *src, char *dest)
+{
+    FILE *fin = fopen(src, "rb");
+    if (NULL == fin)
+    {
+        fprintf(stderr, "[ERROR] Failed to open file %s\n", src);
+        exit(1);
+    }
+    FILE *fout = fopen(dest, "wb");
+
+    // 解码器在id头解析之后创建，输出缓冲区按最长120ms的包分配
+    OpusDecoder *dec = NULL;
+    std::vector<opus_int16> pcm;
+    int sample_rate = 0, skip = 0;
+    ogg_opus_demuxer demuxer([&](const unsigned char *packet, size_t packet_length) {
+        const opus_id_header &id_header = demuxer.get_id_header();
+        if (dec == NULL)
         {
-            continue;
+            int err;
+            sample_rate = id_header.sample_rate;
+            dec = opus_decoder_create(sample_rate, id_header.channel, &err);
+            if (OPUS_OK != err)
+            {
+                // 原始采样率不是opus支持的解码采样率时按48kHz解码
+                sample_rate = 48000;
+                dec = opus_decoder_create(sample_rate, id_header.channel, &err);
+            }
+            if (OPUS_OK != err)
+            {
+                fprintf(stderr, "[ERROR] Failed to create OPUS Decoder\n");
+                dec = NULL;
+                return false;
+            }
+            pcm.resize(sample_rate * 0.12 * id_header.channel);
+            skip = id_header.pre_skip * sample_rate / 48000;
+        }
+        int samples = opus_decode(dec, packet, packet_length, pcm.data(), pcm.size() / id_header.channel, 0);
+        if (samples < 0)
+        {
+            fprintf(stderr, "[ERROR] Failed to opus_decode opus data: %s\n", opus_strerror(samples));
+            return false;
         }
-        // send the page to server
-        ogg_page_encapsulate(os, op);
-        fwrite(op.header, 1, op.header_length, fout);
-        fwrite(op.body, 1, op.body_length, fout);
-        // init a new page
-        init_ogg_page(op);
-        ogg_page_put_packet(os, op, opus, 60);
-    }
-    os.page_flag = 0x04;
-    ogg_page_encapsulate(os, op);
-    fwrite(op.header, 1, op.header_length, fout);
-    fwrite(op.body, 1, op.body_length, fout);
+        // 丢弃编码器延迟引入的pre_skip个采样
+        int drop = std::min(skip, samples);
+        skip -= drop;
+        fwrite(pcm.data() + drop * id_header.channel, sizeof(opus_int16), (samples - drop) * id_header.channel, fout);
+        return true;
+    });
+
+    // 按任意长度分段输入，模拟逐条收到的websocket消息
+    unsigned char data[4096];
+    size_t size;
+    while ((size = fread(data, 1, sizeof(data), fin)) > 0)
+    {
+        if (demuxer.demux(data, size) == -1)
+        {
+            break;
+        }
+    }
+    if (dec != NULL)
+    {
+        opus_decoder_destroy(dec);
+    }
     fclose(fin);
     fclose(fout);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,191 @@
+/**
+ * @Copyright: https://www.xfyun.cn/
+ * @Author: iflytek
+ * @Data: 2019-12-20
+ *
+ * 本文件包含发送音频帧的节拍器（pacer）类定义及实现
+ * iflytek_pacer基于单调时钟的绝对截止时间调度任务，多路音频流共享同一个asio定时器，
+ * 等待期间不占用CPU，且下一帧的截止时间由上一帧的截止时间累加得到，不会累积漂移
+ */
+
+#ifndef _IFLYTEK_PACER_HPP
+#define _IFLYTEK_PACER_HPP
+
+#include <queue>
+#include <vector>
+
+#include "websocketpp/common/asio.hpp"
+#include "websocketpp/common/functional.hpp"
+#include "websocketpp/common/thread.hpp"
+
+/**
+ * @brief 多路音频流共享的节拍器
+ * 所有待执行的任务按截止时间保存在最小堆中，只为最早的截止时间设置一个steady_timer，
+ * 定时器到期时依次取出所有已到期的任务执行
+ *
+ * [public]
+ * @func iflytek_pacer 构造函数
+ * @func now 获得单调时钟的当前时间
+ * @func schedule 在指定的绝对截止时间执行任务
+ * @func size 获得等待执行的任务数
+ * @func clear 丢弃所有等待执行的任务，并取消定时器
+ *
+ * [protected]
+ * @func arm 按最早的截止时间设置定时器
+ * @func on_timer 定时器到期时的回调函数
+ * @member timer 所有任务共享的定时器
+ * @member tasks 按截止时间排序的任务最小堆
+ * @member armed 定时器当前设置的截止时间，没有设置时为time_point::max()
+ * @member sequence 任务序号，截止时间相同时按加入顺序执行
+ * @member lock 保护上述成员的互斥锁
+ */
+class iflytek_pacer
+{
+public:
+    typedef websocketpp::lib::asio::steady_timer::clock_type clock_type;
+    typedef clock_type::time_point time_point;
+    typedef websocketpp::lib::function<void()> task_handler;
+
+    iflytek_pacer(websocketpp::lib::asio::io_service &io_service);
+    static time_point now();
+    void schedule(time_point deadline, task_handler handler);
+    size_t size();
+    void clear();
+
+protected:
+    void arm();
+    void on_timer(const websocketpp::lib::asio::error_code &ec);
+
+private:
+    struct task
+    {
+        time_point deadline;
+        unsigned long long sequence;
+        task_handler handler;
+    };
+
+    struct later
+    {
+        bool operator()(const task &a, const task &b) const
+        {
+            if (a.deadline != b.deadline)
+            {
+                return a.deadline > b.deadline;
+            }
+            return a.sequence > b.sequence;
+        }
+    };
+
+    websocketpp::lib::asio::steady_timer timer;
+    std::priority_queue<task, std::vector<task>, later> tasks;
+    time_point armed;
+    unsigned long long sequence;
+    websocketpp::lib::mutex lock;
+};
+
+/**
+ * @brief 构造函数
+ * @param io_service 驱动定时器的io_service
+ */
+iflytek_pacer::iflytek_pacer(websocketpp::lib::asio::io_service &io_service)
+    : timer(io_service), armed(time_point::max()), sequence(0)
+{
+}
+
+/**
+ * @brief 获得单调时钟的当前时间
+ * @return 当前时间，不受系统时间调整影响
+ */
+iflytek_pacer::time_point iflytek_pacer::now()
+{
+    return clock_type::now();
+}
+
+/**
+ * @brief 在指定的绝对截止时间执行任务
+ * 可以在任意线程调用，任务在运行io_service的线程上执行
+ * 截止时间已过的任务会尽快执行
+ * @param deadline 绝对截止时间
+ * @param handler 任务
+ */
+void iflytek_pacer::schedule(time_point deadline, task_handler handler)
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+    task t = {deadline, this->sequence++, handler};
+    this->tasks.push(t);
+    if (deadline < this->armed)
+    {
+        this->arm();
+    }
+}
+
+/**
+ * @brief 获得等待执行的任务数
+ * @return 等待执行的任务数
+ */
+size_t iflytek_pacer::size()
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+    return this->tasks.size();
+}
+
+/**
+ * @brief 丢弃所有等待执行的任务，并取消定时器
+ * 定时器取消后不再持有io_service，便于io_service在所有会话结束后退出
+ */
+void iflytek_pacer::clear()
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+    this->tasks = std::priority_queue<task, std::vector<task>, later>();
+    this->armed = time_point::max();
+    this->timer.cancel();
+}
+
+/**
+ * @brief 按最早的截止时间设置定时器
+ * 调用者需要持有lock，重新设置会取消之前的等待
+ */
+void iflytek_pacer::arm()
+{
+    if (this->tasks.empty())
+    {
+        this->armed = time_point::max();
+        return;
+    }
+
+    this->armed = this->tasks.top().deadline;
+    this->timer.expires_at(this->armed);
+    this->timer.async_wait(websocketpp::lib::bind(&iflytek_pacer::on_timer, this, websocketpp::lib::placeholders::_1));
+}
+
+/**
+ * @brief 定时器到期时的回调函数
+ * 取出所有已到期的任务，在锁外依次执行，然后按剩余任务中最早的截止时间重新设置定时器
+ * @param ec 定时器状态，定时器被重新设置而取消时忽略
+ */
+void iflytek_pacer::on_timer(const websocketpp::lib::asio::error_code &ec)
+{
+    if (ec)
+    {
+        return;
+    }
+
+    std::vector<task_handler> due;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        time_point current = now();
+        while (!this->tasks.empty() && this->tasks.top().deadline <= current)
+        {
+            due.push_back(this->tasks.top().handler);
+            this->tasks.pop();
+        }
+        this->arm();
+    }
+
+    for (size_t i = 0; i < due.size(); i++)
+    {
+        due[i]();
+    }
+}
+
+#endif
@@ -0,0 +1,391 @@
+/**
+ * @Copyright: https://www.xfyun.cn/
+ * @Author: iflytek
+ * @Data: 2019-12-20
+ *
+ * 本文件包含单声道16位PCM音频的流式重采样类定义及实现
+ * 采用多相FIR滤波器（Kaiser窗sinc），按输入、输出采样率的最简比L/M在L个相位之间切换，
+ * 每个输出采样点只计算一次与输入的点积，点积运行时按CPU支持的指令集选择AVX2、SSE或标量实现
+ * 相邻两次调用之间保留滤波器所需的历史采样，任意长度分段输入的结果与一次输入全部数据相同
+ */
+
+#ifndef _IFLYTEK_RESAMPLER_HPP
+#define _IFLYTEK_RESAMPLER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define IFLYTEK_RESAMPLER_SIMD
+#endif
+
+/**
+ * @brief 单声道16位PCM音频的流式重采样
+ * 输入、输出均为小端的16位采样（与编码器接受的原始数据相同）
+ *
+ * [public]
+ * @func create 按输入、输出采样率生成多相滤波器
+ * @func resample 重采样一段输入数据
+ * @func flush 输入结束后输出滤波器中剩余的采样
+ * @func read 从文件中读取并重采样，恰好输出指定长度的数据
+ * @func reset 清空历史采样，开始新的音频流
+ * @func get_max_output 获得一次重采样的最大输出字节长度
+ *
+ * [private]
+ * @func kaiser 计算Kaiser窗的值
+ * @func dot 按CPU支持的指令集计算输入与某一相位系数的点积
+ * @func process 对已缓存的输入计算尽可能多的输出采样
+ * @member up, down 输出、输入采样率的最简比L/M
+ * @member taps 每个相位的系数个数，为8的倍数
+ * @member half 滤波器半长（输入采样点数），输出采样点前后各使用half个输入采样点
+ * @member phase 下一个输出采样点所在的相位
+ * @member coefs 所有相位的系数，第p个相位位于coefs[p * taps]
+ * @member history 尚未消耗完的输入采样，开头为上次保留的历史采样
+ * @member position 下一个输出采样点的窗口在history中的起始位置
+ * @member input_count, output_count 累计的输入、输出采样数，flush时按比例确定剩余的输出采样数
+ * @member pending read中重采样后尚未返回的数据
+ * @member finished read是否已读到文件末尾并flush
+ */
+class iflytek_resampler
+{
+public:
+    iflytek_resampler();
+    int create(int input_rate, int output_rate);
+    int resample(const unsigned char *source, int source_length, unsigned char *dest);
+    int flush(unsigned char *dest);
+    int read(FILE *fin, unsigned char *dest, int length);
+    void reset();
+    int get_max_output(int source_length) const;
+
+private:
+    static double kaiser(double x, double beta);
+    float dot(const float *input, const float *coef) const;
+    int process(unsigned char *dest);
+
+private:
+    int up, down, taps, half, phase;
+    std::vector<float> coefs, history;
+    size_t position;
+    long long input_count, output_count;
+    std::vector<unsigned char> pending;
+    bool finished;
+};
+
+/**
+ * @brief 点积，标量实现，用于不支持SIMD的平台
+ * 使用4个累加器，便于编译器自动向量化
+ */
+inline float resampler_dot_scalar(const float *input, const float *coef, int taps)
+{
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i < taps; i += 4)
+    {
+        s0 += input[i] * coef[i];
+        s1 += input[i + 1] * coef[i + 1];
+        s2 += input[i + 2] * coef[i + 2];
+        s3 += input[i + 3] * coef[i + 3];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef IFLYTEK_RESAMPLER_SIMD
+/**
+ * @brief 点积，SSE实现，每次计算8个乘积，taps为8的倍数
+ */
+__attribute__((target("sse2"))) inline float resampler_dot_sse(const float *input, const float *coef, int taps)
+{
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    for (int i = 0; i < taps; i += 8)
+    {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(input + i), _mm_loadu_ps(coef + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(input + i + 4), _mm_loadu_ps(coef + i + 4)));
+    }
+    s0 = _mm_add_ps(s0, s1);
+    s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+    s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+    return _mm_cvtss_f32(s0);
+}
+
+/**
+ * @brief 点积，AVX2+FMA实现，每次计算16个乘积，剩余的8个交给单个累加器
+ */
+__attribute__((target("avx2,fma"))) inline float resampler_dot_avx2(const float *input, const float *coef, int taps)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= taps; i += 16)
+    {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(input + i), _mm256_loadu_ps(coef + i), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(input + i + 8), _mm256_loadu_ps(coef + i + 8), s1);
+    }
+    if (i < taps)
+    {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(input + i), _mm256_loadu_ps(coef + i), s0);
+    }
+    s0 = _mm256_add_ps(s0, s1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+#endif
+
+/**
+ * @brief 运行时检测CPU支持的SIMD指令集
+ * @return 2表示AVX2及FMA，1表示SSE2，0表示只使用标量实现
+ */
+int get_resampler_simd_level()
+{
+#ifdef IFLYTEK_RESAMPLER_SIMD
+    static const int level = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? 2 : (__builtin_cpu_supports("sse2") ? 1 : 0);
+    return level;
+#else
+    return 0;
+#endif
+}
+
+iflytek_resampler::iflytek_resampler()
+    : up(1), down(1), taps(0), half(0), phase(0), position(0), input_count(0), output_count(0), finished(false)
+{
+}
+
+/**
+ * @brief 按输入、输出采样率生成多相滤波器
+ * 截止频率为两者中较低的奈奎斯特频率的0.91倍，降采样时滤波器按比例加长以保持相同的过渡带宽度
+ * 每个相位的系数归一化为和为1，直流增益恒为1
+ * @param input_rate 输入采样率，如8000, 16000, 44100, 48000
+ * @param output_rate 输出采样率，即编码器的采样率
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_resampler::create(int input_rate, int output_rate)
+{
+    if (input_rate <= 0 || output_rate <= 0)
+    {
+        fprintf(stderr, "[ERROR] Unsupported resampling rate %d -> %d\n", input_rate, output_rate);
+        return -1;
+    }
+
+    int a = input_rate, b = output_rate;
+    while (b != 0)
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    this->up = output_rate / a;
+    this->down = input_rate / a;
+    if (this->up > 1024)
+    {
+        // 相位数过多时系数表过大，如44100 -> 16001
+        fprintf(stderr, "[ERROR] Unsupported resampling rate %d -> %d\n", input_rate, output_rate);
+        return -1;
+    }
+
+    // 截止频率（相对输入的奈奎斯特频率），Kaiser窗beta = 8.6时阻带衰减约为90dB
+    const double ratio = std::min(1.0, (double)output_rate / input_rate);
+    const double cutoff = 0.91 * ratio;
+    const double beta = 8.6;
+    this->half = (int)std::ceil(24 / ratio);
+    this->taps = (2 * this->half + 7) / 8 * 8;
+
+    this->coefs.assign((size_t)this->up * this->taps, 0.0f);
+    for (int p = 0; p < this->up; p++)
+    {
+        // 第p个相位的输出采样点位于窗口中第half - 1个输入采样点之后p / up处
+        double frac = (double)p / this->up, sum = 0;
+        std::vector<double> h(2 * this->half);
+        for (int k = 0; k < 2 * this->half; k++)
+        {
+            double d = k - (this->half - 1) - frac;
+            double x = M_PI * cutoff * d;
+            double sinc = d == 0 ? 1.0 : std::sin(x) / x;
+            h[k] = sinc * kaiser(d / this->half, beta);
+            sum += h[k];
+        }
+        for (int k = 0; k < 2 * this->half; k++)
+        {
+            this->coefs[(size_t)p * this->taps + k] = (float)(h[k] / sum);
+        }
+    }
+
+    this->reset();
+    return 0;
+}
+
+/**
+ * @brief 清空历史采样，开始新的音频流
+ * 窗口开头预先填充half - 1个0，第一个输出采样点与第一个输入采样点对齐，不引入时延
+ */
+void iflytek_resampler::reset()
+{
+    this->history.assign(this->half - 1, 0.0f);
+    this->position = 0;
+    this->phase = 0;
+    this->input_count = 0;
+    this->output_count = 0;
+    this->pending.clear();
+    this->finished = false;
+}
+
+/**
+ * @brief 获得一次重采样的最大输出字节长度
+ * @param source_length 输入数据的字节长度
+ * @return 输出数据的最大字节长度，用于预先分配目的缓冲区（同样适用于flush）
+ */
+int iflytek_resampler::get_max_output(int source_length) const
+{
+    long long samples = ((long long)(source_length / 2) + this->half + this->taps) * this->up / this->down + 1;
+    return (int)samples * 2;
+}
+
+/**
+ * @brief 重采样一段输入数据
+ * 输出采样点所需的后续输入尚未到达时，该采样点留到下次调用或flush时输出
+ * @param source 原始数据，长度为奇数时忽略最后一个字节
+ * @param source_length 原始数据字节长度
+ * @param dest 目的数据，长度至少为get_max_output(source_length)
+ * @return 目的数据的字节长度
+ */
+int iflytek_resampler::resample(const unsigned char *source, int source_length, unsigned char *dest)
+{
+    int count = source_length / 2;
+    size_t offset = this->history.size();
+    this->history.resize(offset + count);
+    for (int i = 0; i < count; i++)
+    {
+        this->history[offset + i] = (short)(source[2 * i] | (source[2 * i + 1] << 8));
+    }
+    this->input_count += count;
+
+    return this->process(dest) * 2;
+}
+
+/**
+ * @brief 输入结束后输出滤波器中剩余的采样
+ * 在输入末尾补0，输出采样总数为输入采样总数乘以L/M后向上取整
+ * @param dest 目的数据，长度至少为get_max_output(0)
+ * @return 目的数据的字节长度
+ */
+int iflytek_resampler::flush(unsigned char *dest)
+{
+    long long total = (this->input_count * this->up + this->down - 1) / this->down;
+    this->history.resize(this->history.size() + this->taps, 0.0f);
+    int count = this->process(dest);
+    if (this->output_count > total)
+    {
+        count -= (int)(this->output_count - total);
+        this->output_count = total;
+    }
+    return std::max(count, 0) * 2;
+}
+
+/**
+ * @brief 从文件中读取并重采样，恰好输出指定长度的数据
+ * 用于替换demo中按帧读取原始音频的fread，多余的输出缓存到下次调用
+ * @param fin 以输入采样率保存的原始音频文件
+ * @param dest 目的数据
+ * @param length 需要的字节长度，通常为编码器一帧或多帧的长度
+ * @return 目的数据的字节长度，只有在文件结束时才会小于length
+ */
+int iflytek_resampler::read(FILE *fin, unsigned char *dest, int length)
+{
+    unsigned char buffer[4096];
+    while ((int)this->pending.size() < length && !this->finished)
+    {
+        // 每次读取的输入约为仍需输出长度对应的输入长度，避免一次读取过多
+        size_t need = ((size_t)(length - this->pending.size()) * this->down / this->up + 2) & ~(size_t)1;
+        int size = fread(buffer, sizeof(char), std::min(need, sizeof(buffer)), fin);
+        size_t offset = this->pending.size();
+        this->pending.resize(offset + this->get_max_output(size));
+        int n = size > 0 ? this->resample(buffer, size, this->pending.data() + offset) : this->flush(this->pending.data() + offset);
+        this->pending.resize(offset + n);
+        this->finished = size <= 0;
+    }
+
+    int n = std::min(length, (int)this->pending.size());
+    memcpy(dest, this->pending.data(), n);
+    this->pending.erase(this->pending.begin(), this->pending.begin() + n);
+    return n;
+}
+
+/**
+ * @brief 计算Kaiser窗的值
+ * @param x 相对窗口中心的位置，范围为[-1, 1]
+ * @param beta 形状参数
+ * @return 窗的值，窗口外为0
+ */
+double iflytek_resampler::kaiser(double x, double beta)
+{
+    if (x <= -1 || x >= 1)
+    {
+        return 0;
+    }
+
+    // 第一类零阶修正贝塞尔函数的级数展开
+    auto bessel_i0 = [](double v) {
+        double sum = 1, term = 1;
+        for (int k = 1; k < 50; k++)
+        {
+            term *= (v / (2 * k)) * (v / (2 * k));
+            sum += term;
+        }
+        return sum;
+    };
+    return bessel_i0(beta * std::sqrt(1 - x * x)) / bessel_i0(beta);
+}
+
+/**
+ * @brief 按CPU支持的指令集计算输入与某一相位系数的点积
+ * @param input 窗口的起始输入采样点
+ * @param coef 相位的系数
+ * @return 输出采样点的值
+ */
+float iflytek_resampler::dot(const float *input, const float *coef) const
+{
+#ifdef IFLYTEK_RESAMPLER_SIMD
+    switch (get_resampler_simd_level())
+    {
+    case 2:
+        return resampler_dot_avx2(input, coef, this->taps);
+    case 1:
+        return resampler_dot_sse(input, coef, this->taps);
+    }
+#endif
+    return resampler_dot_scalar(input, coef, this->taps);
+}
+
+/**
+ * @brief 对已缓存的输入计算尽可能多的输出采样
+ * 每输出一个采样点，相位前进M，窗口前进相位溢出L的次数；结束时丢弃已不再需要的输入
+ * @param dest 目的数据，小端的16位采样
+ * @return 输出采样数
+ */
+int iflytek_resampler::process(unsigned char *dest)
+{
+    int count = 0;
+    // 系数表按taps对齐，窗口末尾的补齐部分系数为0，但仍会读取，因此需要taps个可读的输入
+    while (this->position + this->taps <= this->history.size())
+    {
+        float v = this->dot(this->history.data() + this->position, this->coefs.data() + (size_t)this->phase * this->taps);
+        long r = std::lround(v);
+        short sample = (short)(r > 32767 ? 32767 : (r < -32768 ? -32768 : r));
+        dest[2 * count] = sample & 0xFF;
+        dest[2 * count + 1] = (sample >> 8) & 0xFF;
+        count++;
+
+        this->phase += this->down;
+        this->position += this->phase / this->up;
+        this->phase %= this->up;
+    }
+    this->output_count += count;
+
+    size_t consumed = std::min(this->position, this->history.size());
+    this->history.erase(this->history.begin(), this->history.begin() + consumed);
+    this->position -= consumed;
+    return count;
+}
+
+#endif
@@ -0,0 +1,937 @@
+/**
+ * @Copyright: https://www.xfyun.cn/
+ * @Author: iflytek
+ * @Data: 2019-12-20
+ *
+ * 本文件包含语音听写（iat）结果消息的流式解析类定义及实现
+ * iflytek_iat_result顺序扫描一遍结果消息，只提取code、sid、message、data.result.ls、data.result.sn
+ * 以及data.result.ws[].cw[0].w，识别出的词直接追加到会话的结果中，其余字段跳过，不构造json对象
+ */
+
+#ifndef _IFLYTEK_RESULT_HPP
+#define _IFLYTEK_RESULT_HPP
+
+#include <cstring>
+#include <string>
+
+/**
+ * @brief 语音听写会话的结果
+ * 每个会话一个对象，parse每次解析一条结果消息，code、message、ls、sn为最近一条消息的值，
+ * sid在消息中出现时更新，text为所有结果消息中识别出的词按顺序拼接的结果
+ *
+ * [public]
+ * @func iflytek_iat_result 构造函数
+ * @func parse 解析一条结果消息
+ * @func clear 清空会话的结果
+ * @func get_code 获得返回码，0表示成功
+ * @func get_sid 获得会话id
+ * @func get_message 获得返回码的描述
+ * @func is_last 是否是最后一片结果
+ * @func get_sn 获得结果序号
+ * @func get_text 获得拼接后的识别结果
+ *
+ * [protected]
+ * @func parse_root 解析消息最外层的对象
+ * @func parse_data 解析data对象
+ * @func parse_result 解析data.result对象
+ * @func parse_ws 解析data.result.ws数组
+ * @func parse_cw 解析data.result.ws[].cw数组，只取第一个候选词
+ * @func parse_string 解析字符串并处理转义，追加到指定的字符串
+ * @func parse_key 解析对象的键及其后的冒号
+ * @func parse_integer 解析整数
+ * @func parse_bool 解析布尔值
+ * @func skip_value 跳过任意值
+ * @func skip_space 跳过空白字符
+ * @member cursor 当前解析位置
+ * @member end 消息结尾
+ */
+class iflytek_iat_result
+{
+public:
+    iflytek_iat_result();
+    int parse(const char *data, size_t length);
+    int parse(const std::string &payload);
+    void clear();
+    long get_code() const;
+    const std::string &get_sid() const;
+    const std::string &get_message() const;
+    bool is_last() const;
+    long get_sn() const;
+    const std::string &get_text() const;
+
+protected:
+    int parse_root();
+    int parse_data();
+    int parse_result();
+    int parse_ws();
+    int parse_cw();
+    int parse_string(std::string *out);
+    int parse_key(const char **key, size_t *length);
+    int parse_integer(long *value);
+    int parse_bool(bool *value);
+    int skip_value();
+    void skip_space();
+
+private:
+    long code, sn;
+    bool ls;
+    std::string sid, message, text;
+    const char *cursor, *end;
+};
+
+/**
+ * @brief 构造函数
+ */
+iflytek_iat_result::iflytek_iat_result()
+    : code(-1), sn(0), ls(false), cursor(NULL), end(NULL)
+{
+}
+
+/**
+ * @brief 解析一条结果消息
+ * 解析失败时已追加到text的词会保留，code被置为-1
+ * @param data 消息内容
+ * @param length 消息长度
+ * @return 成功时返回0，消息不是合法的json对象时返回-1
+ */
+int iflytek_iat_result::parse(const char *data, size_t length)
+{
+    this->code = -1;
+    this->sn = 0;
+    this->ls = false;
+    this->message.clear();
+    this->cursor = data;
+    this->end = data + length;
+
+    if (this->parse_root() == -1)
+    {
+        this->code = -1;
+        return -1;
+    }
+    this->skip_space();
+    if (this->cursor != this->end)
+    {
+        this->code = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 解析一条结果消息
+ * @param payload 消息内容
+ * @return 成功时返回0，消息不是合法的json对象时返回-1
+ */
+int iflytek_iat_result::parse(const std::string &payload)
+{
+    return this->parse(payload.data(), payload.size());
+}
+
+/**
+ * @brief 清空会话的结果
+ */
+void iflytek_iat_result::clear()
+{
+    this->code = -1;
+    this->sn = 0;
+    this->ls = false;
+    this->sid.clear();
+    this->message.clear();
+    this->text.clear();
+}
+
+/**
+ * @brief 获得返回码
+ * @return 最近一条消息的返回码，0表示成功，解析失败或消息中没有code时为-1
+ */
+long iflytek_iat_result::get_code() const
+{
+    return this->code;
+}
+
+/**
+ * @brief 获得会话id
+ * @return 会话id
+ */
+const std::string &iflytek_iat_result::get_sid() const
+{
+    return this->sid;
+}
+
+/**
+ * @brief 获得返回码的描述
+ * @return 最近一条消息的返回码描述
+ */
+const std::string &iflytek_iat_result::get_message() const
+{
+    return this->message;
+}
+
+/**
+ * @brief 是否是最后一片结果
+ * @return 最近一条消息的data.result.ls
+ */
+bool iflytek_iat_result::is_last() const
+{
+    return this->ls;
+}
+
+/**
+ * @brief 获得结果序号
+ * @return 最近一条消息的data.result.sn
+ */
+long iflytek_iat_result::get_sn() const
+{
+    return this->sn;
+}
+
+/**
+ * @brief 获得拼接后的识别结果
+ * @return 识别结果
+ */
+const std::string &iflytek_iat_result::get_text() const
+{
+    return this->text;
+}
+
+/**
+ * @brief 解析消息最外层的对象
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_iat_result::parse_root()
+{
+    this->skip_space();
+    if (this->cursor == this->end || *this->cursor != '{')
+    {
+        return -1;
+    }
+    this->cursor++;
+
+    this->skip_space();
+    if (this->cursor != this->end && *this->cursor == '}')
+    {
+        this->cursor++;
+        return 0;
+    }
+
+    while (true)
+    {
+        const char *key;
+        size_t length;
+        if (this->parse_key(&key, &length) == -1)
+        {
+            return -1;
+        }
+
+        int ret;
+        if (length == 4 && !memcmp(key, "code", 4))
+        {
+            ret = this->parse_integer(&this->code);
+        }
+        else if (length == 3 && !memcmp(key, "sid", 3))
+        {
+            // sid可能为null，此时保留之前的值
+            this->skip_space();
+            if (this->cursor != this->end && *this->cursor == '"')
+            {
+                this->sid.clear();
+                ret = this->parse_string(&this->sid);
+            }
+            else
+            {
+                ret = this->skip_value();
+            }
+        }
+        else if (length == 7 && !memcmp(key, "message", 7))
+        {
+            this->skip_space();
+            ret = this->cursor != this->end && *this->cursor == '"' ? this->parse_string(&this->message) : this->skip_value();
+        }
+        else if (length == 4 && !memcmp(key, "data", 4))
+        {
+            ret = this->parse_data();
+        }
+        else
+        {
+            ret = this->skip_value();
+        }
+        if (ret == -1)
+        {
+            return -1;
+        }
+
+        this->skip_space();
+        if (this->cursor == this->end)
+        {
+            return -1;
+        }
+        if (*this->cursor == '}')
+        {
+            this->cursor++;
+            return 0;
+        }
+        if (*this->cursor != ',')
+        {
+            return -1;
+        }
+        this->cursor++;
+    }
+}
+
+/**
+ * @brief 解析data对象，data为null时跳过
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_iat_result::parse_data()
+{
+    this->skip_space();
+    if (this->cursor == this->end || *this->cursor != '{')
+    {
+        return this->skip_value();
+    }
+    this->cursor++;
+
+    this->skip_space();
+    if (this->cursor != this->end && *this->cursor == '}')
+    {
+        this->cursor++;
+        return 0;
+    }
+
+    while (true)
+    {
+        const char *key;
+        size_t length;
+        if (this->parse_key(&key, &length) == -1)
+        {
+            return -1;
+        }
+
+        int ret = length == 6 && !memcmp(key, "result", 6) ? this->parse_result() : this->skip_value();
+        if (ret == -1)
+        {
+            return -1;
+        }
+
+        this->skip_space();
+        if (this->cursor == this->end)
+        {
+            return -1;
+        }
+        if (*this->cursor == '}')
+        {
+            this->cursor++;
+            return 0;
+        }
+        if (*this->cursor != ',')
+        {
+            return -1;
+        }
+        this->cursor++;
+    }
+}
+
+/**
+ * @brief 解析data.result对象，result为null时跳过
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_iat_result::parse_result()
+{
+    this->skip_space();
+    if (this->cursor == this->end || *this->cursor != '{')
+    {
+        return this->skip_value();
+    }
+    this->cursor++;
+
+    this->skip_space();
+    if (this->cursor != this->end && *this->cursor == '}')
+    {
+        this->cursor++;
+        return 0;
+    }
+
+    while (true)
+    {
+        const char *key;
+        size_t length;
+        if (this->parse_key(&key, &length) == -1)
+        {
+            return -1;
+        }
+
+        int ret;
+        if (length == 2 && !memcmp(key, "ls", 2))
+        {
+            ret = this->parse_bool(&this->ls);
+        }
+        else if (length == 2 && !memcmp(key, "sn", 2))
+        {
+            ret = this->parse_integer(&this->sn);
+        }
+        else if (length == 2 && !memcmp(key, "ws", 2))
+        {
+            ret = this->parse_ws();
+        }
+        else
+        {
+            ret = this->skip_value();
+        }
+        if (ret == -1)
+        {
+            return -1;
+        }
+
+        this->skip_space();
+        if (this->cursor == this->end)
+        {
+            return -1;
+        }
+        if (*this->cursor == '}')
+        {
+            this->cursor++;
+            return 0;
+        }
+        if (*this->cursor != ',')
+        {
+            return -1;
+        }
+        this->cursor++;
+    }
+}
+
+/**
+ * @brief 解析data.result.ws数组，依次解析每个元素的cw数组
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_iat_result::parse_ws()
+{
+    this->skip_space();
+    if (this->cursor == this->end || *this->cursor != '[')
+    {
+        return this->skip_value();
+    }
+    this->cursor++;
+
+    this->skip_space();
+    if (this->cursor != this->end && *this->cursor == ']')
+    {
+        this->cursor++;
+        return 0;
+    }
+
+    while (true)
+    {
+        // 每个元素为一个分词对象
+        this->skip_space();
+        if (this->cursor == this->end)
+        {
+            return -1;
+        }
+        if (*this->cursor != '{')
+        {
+            if (this->skip_value() == -1)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            this->cursor++;
+            this->skip_space();
+            if (this->cursor != this->end && *this->cursor == '}')
+            {
+                this->cursor++;
+            }
+            else
+            {
+                while (true)
+                {
+                    const char *key;
+                    size_t length;
+                    if (this->parse_key(&key, &length) == -1)
+                    {
+                        return -1;
+                    }
+
+                    int ret = length == 2 && !memcmp(key, "cw", 2) ? this->parse_cw() : this->skip_value();
+                    if (ret == -1)
+                    {
+                        return -1;
+                    }
+
+                    this->skip_space();
+                    if (this->cursor == this->end)
+                    {
+                        return -1;
+                    }
+                    if (*this->cursor == '}')
+                    {
+                        this->cursor++;
+                        break;
+                    }
+                    if (*this->cursor != ',')
+                    {
+                        return -1;
+                    }
+                    this->cursor++;
+                }
+            }
+        }
+
+        this->skip_space();
+        if (this->cursor == this->end)
+        {
+            return -1;
+        }
+        if (*this->cursor == ']')
+        {
+            this->cursor++;
+            return 0;
+        }
+        if (*this->cursor != ',')
+        {
+            return -1;
+        }
+        this->cursor++;
+    }
+}
+
+/**
+ * @brief 解析data.result.ws[].cw数组，第一个候选词的w追加到text，其余候选词跳过
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_iat_result::parse_cw()
+{
+    this->skip_space();
+    if (this->cursor == this->end || *this->cursor != '[')
+    {
+        return this->skip_value();
+    }
+    this->cursor++;
+
+    this->skip_space();
+    if (this->cursor != this->end && *this->cursor == ']')
+    {
+        this->cursor++;
+        return 0;
+    }
+
+    bool first = true;
+    while (true)
+    {
+        this->skip_space();
+        if (this->cursor == this->end)
+        {
+            return -1;
+        }
+        if (!first || *this->cursor != '{')
+        {
+            if (this->skip_value() == -1)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            this->cursor++;
+            this->skip_space();
+            if (this->cursor != this->end && *this->cursor == '}')
+            {
+                this->cursor++;
+            }
+            else
+            {
+                while (true)
+                {
+                    const char *key;
+                    size_t length;
+                    if (this->parse_key(&key, &length) == -1)
+                    {
+                        return -1;
+                    }
+
+                    int ret;
+                    this->skip_space();
+                    if (length == 1 && key[0] == 'w' && this->cursor != this->end && *this->cursor == '"')
+                    {
+                        ret = this->parse_string(&this->text);
+                    }
+                    else
+                    {
+                        ret = this->skip_value();
+                    }
+                    if (ret == -1)
+                    {
+                        return -1;
+                    }
+
+                    this->skip_space();
+                    if (this->cursor == this->end)
+                    {
+                        return -1;
+                    }
+                    if (*this->cursor == '}')
+                    {
+                        this->cursor++;
+                        break;
+                    }
+                    if (*this->cursor != ',')
+                    {
+                        return -1;
+                    }
+                    this->cursor++;
+                }
+            }
+        }
+        first = false;
+
+        this->skip_space();
+        if (this->cursor == this->end)
+        {
+            return -1;
+        }
+        if (*this->cursor == ']')
+        {
+            this->cursor++;
+            return 0;
+        }
+        if (*this->cursor != ',')
+        {
+            return -1;
+        }
+        this->cursor++;
+    }
+}
+
+/**
+ * @brief 解析字符串并处理转义，\u转义按utf-8编码（包括代理对）
+ * @param out 追加解析结果的字符串，为NULL时只跳过
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_iat_result::parse_string(std::string *out)
+{
+    if (this->cursor == this->end || *this->cursor != '"')
+    {
+        return -1;
+    }
+    this->cursor++;
+
+    while (true)
+    {
+        // 没有转义的连续片段整体追加
+        const char *start = this->cursor;
+        while (this->cursor != this->end && *this->cursor != '"' && *this->cursor != '\\' && (unsigned char)*this->cursor >= 0x20)
+        {
+            this->cursor++;
+        }
+        if (out != NULL && this->cursor != start)
+        {
+            out->append(start, this->cursor - start);
+        }
+        if (this->cursor == this->end || (unsigned char)*this->cursor < 0x20)
+        {
+            return -1;
+        }
+        if (*this->cursor == '"')
+        {
+            this->cursor++;
+            return 0;
+        }
+
+        // 转义字符
+        if (++this->cursor == this->end)
+        {
+            return -1;
+        }
+        char c = *this->cursor++;
+        switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            break;
+        case 'b':
+            c = '\b';
+            break;
+        case 'f':
+            c = '\f';
+            break;
+        case 'n':
+            c = '\n';
+            break;
+        case 'r':
+            c = '\r';
+            break;
+        case 't':
+            c = '\t';
+            break;
+        case 'u':
+        {
+            unsigned long codepoint = 0;
+            for (int pair = 0; pair < 2; pair++)
+            {
+                if (this->end - this->cursor < 4)
+                {
+                    return -1;
+                }
+                unsigned long unit = 0;
+                for (int i = 0; i < 4; i++)
+                {
+                    char h = *this->cursor++;
+                    unit <<= 4;
+                    if (h >= '0' && h <= '9')
+                    {
+                        unit |= h - '0';
+                    }
+                    else if (h >= 'a' && h <= 'f')
+                    {
+                        unit |= h - 'a' + 10;
+                    }
+                    else if (h >= 'A' && h <= 'F')
+                    {
+                        unit |= h - 'A' + 10;
+                    }
+                    else
+                    {
+                        return -1;
+                    }
+                }
+
+                if (pair == 0)
+                {
+                    codepoint = unit;
+                    if (unit >= 0xdc00 && unit <= 0xdfff)
+                    {
+                        return -1;
+                    }
+                    if (unit < 0xd800 || unit > 0xdbff)
+                    {
+                        break;
+                    }
+                    // 高代理项之后必须紧跟低代理项
+                    if (this->end - this->cursor < 2 || this->cursor[0] != '\\' || this->cursor[1] != 'u')
+                    {
+                        return -1;
+                    }
+                    this->cursor += 2;
+                }
+                else
+                {
+                    if (unit < 0xdc00 || unit > 0xdfff)
+                    {
+                        return -1;
+                    }
+                    codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (unit - 0xdc00);
+                }
+            }
+
+            if (out != NULL)
+            {
+                if (codepoint < 0x80)
+                {
+                    out->push_back((char)codepoint);
+                }
+                else if (codepoint < 0x800)
+                {
+                    out->push_back((char)(0xc0 | (codepoint >> 6)));
+                    out->push_back((char)(0x80 | (codepoint & 0x3f)));
+                }
+                else if (codepoint < 0x10000)
+                {
+                    out->push_back((char)(0xe0 | (codepoint >> 12)));
+                    out->push_back((char)(0x80 | ((codepoint >> 6) & 0x3f)));
+                    out->push_back((char)(0x80 | (codepoint & 0x3f)));
+                }
+                else
+                {
+                    out->push_back((char)(0xf0 | (codepoint >> 18)));
+                    out->push_back((char)(0x80 | ((codepoint >> 12) & 0x3f)));
+                    out->push_back((char)(0x80 | ((codepoint >> 6) & 0x3f)));
+                    out->push_back((char)(0x80 | (codepoint & 0x3f)));
+                }
+            }
+            continue;
+        }
+        default:
+            return -1;
+        }
+        if (out != NULL)
+        {
+            out->push_back(c);
+        }
+    }
+}
+
+/**
+ * @brief 解析对象的键及其后的冒号
+ * 结果消息的键不含转义字符，直接返回键在消息中的位置，含转义字符的键不会与任何需要提取的字段匹配
+ * @param key 键的起始位置
+ * @param length 键的长度
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_iat_result::parse_key(const char **key, size_t *length)
+{
+    this->skip_space();
+    const char *start = this->cursor + 1;
+    if (this->parse_string(NULL) == -1)
+    {
+        return -1;
+    }
+    *key = start;
+    *length = this->cursor - 1 - start;
+
+    this->skip_space();
+    if (this->cursor == this->end || *this->cursor != ':')
+    {
+        return -1;
+    }
+    this->cursor++;
+    return 0;
+}
+
+/**
+ * @brief 解析整数，值不是整数时跳过且不修改value
+ * @param value 解析结果
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_iat_result::parse_integer(long *value)
+{
+    this->skip_space();
+    const char *start = this->cursor;
+    if (this->skip_value() == -1)
+    {
+        return -1;
+    }
+
+    const char *p = start;
+    bool negative = p != this->cursor && *p == '-';
+    if (negative)
+    {
+        p++;
+    }
+    if (p == this->cursor || *p < '0' || *p > '9')
+    {
+        return 0;
+    }
+    long result = 0;
+    while (p != this->cursor && *p >= '0' && *p <= '9')
+    {
+        result = result * 10 + (*p++ - '0');
+    }
+    if (p != this->cursor)
+    {
+        return 0;
+    }
+    *value = negative ? -result : result;
+    return 0;
+}
+
+/**
+ * @brief 解析布尔值，值不是布尔值时跳过且不修改value
+ * @param value 解析结果
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_iat_result::parse_bool(bool *value)
+{
+    this->skip_space();
+    if (this->end - this->cursor >= 4 && !memcmp(this->cursor, "true", 4))
+    {
+        *value = true;
+        this->cursor += 4;
+        return 0;
+    }
+    if (this->end - this->cursor >= 5 && !memcmp(this->cursor, "false", 5))
+    {
+        *value = false;
+        this->cursor += 5;
+        return 0;
+    }
+    return this->skip_value();
+}
+
+/**
+ * @brief 跳过任意值，对象和数组按嵌套深度跳过，不递归
+ * @return 成功时返回0，失败时返回-1
+ */
+int iflytek_iat_result::skip_value()
+{
+    int depth = 0;
+    do
+    {
+        this->skip_space();
+        if (this->cursor == this->end)
+        {
+            return -1;
+        }
+
+        char c = *this->cursor;
+        if (c == '"')
+        {
+            if (this->parse_string(NULL) == -1)
+            {
+                return -1;
+            }
+        }
+        else if (c == '{' || c == '[')
+        {
+            depth++;
+            this->cursor++;
+            continue;
+        }
+        else if (c == '}' || c == ']')
+        {
+            if (depth == 0)
+            {
+                return -1;
+            }
+            depth--;
+            this->cursor++;
+        }
+        else if (c == ',' || c == ':')
+        {
+            if (depth == 0)
+            {
+                return -1;
+            }
+            this->cursor++;
+            continue;
+        }
+        else if (c == '-' || (c >= '0' && c <= '9'))
+        {
+            this->cursor++;
+            while (this->cursor != this->end && ((*this->cursor >= '0' && *this->cursor <= '9') || *this->cursor == '.' ||
+                                                 *this->cursor == 'e' || *this->cursor == 'E' || *this->cursor == '+' || *this->cursor == '-'))
+            {
+                this->cursor++;
+            }
+        }
+        else if (this->end - this->cursor >= 4 && (!memcmp(this->cursor, "true", 4) || !memcmp(this->cursor, "null", 4)))
+        {
+            this->cursor += 4;
+        }
+        else if (this->end - this->cursor >= 5 && !memcmp(this->cursor, "false", 5))
+        {
+            this->cursor += 5;
+        }
+        else
+        {
+            return -1;
+        }
+    } while (depth > 0);
+
+    return 0;
+}
+
+/**
+ * @brief 跳过空白字符
+ */
+void iflytek_iat_result::skip_space()
+{
+    while (this->cursor != this->end && (*this->cursor == ' ' || *this->cursor == '\t' || *this->cursor == '\n' || *this->cursor == '\r'))
+    {
+        this->cursor++;
+    }
+}
+
+#endif
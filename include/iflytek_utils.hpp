@@ -11,11 +11,14 @@
 
 #include <string>
 #include <sstream>
+#include <cctype>
+#include <chrono>
+#include <thread>
 #include <openssl/hmac.h>
 #include <openssl/md5.h>
-#include <boost/archive/iterators/base64_from_binary.hpp>
-#include <boost/archive/iterators/binary_from_base64.hpp>
-#include <boost/archive/iterators/transform_width.hpp>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
 
 /**
  * @brief hmac_sha256算法，利用key对data进行加密认证
@@ -25,7 +28,7 @@
  */
 std::string get_hmac_sha256(const std::string &data, const std::string &key)
 {
-	unsigned char *result = new unsigned char[40];
+	unsigned char result[EVP_MAX_MD_SIZE];
 	unsigned int result_len = 0;
 
 	HMAC_CTX *ctx = HMAC_CTX_new();
@@ -39,51 +42,412 @@ std::string get_hmac_sha256(const std::string &data, const std::string &key)
 }
 
 /**
- * @brief base64编码算法
+ * @brief base64编码后的长度
+ * @param length 待编码数据的长度
+ * @return 编码结果的长度（含末尾的'='）
+ */
+size_t get_base64_encode_length(size_t length)
+{
+	return (length + 2) / 3 * 4;
+}
+
+/**
+ * @brief base64解码后的最大长度
+ * @param length 待解码数据的长度
+ * @return 解码结果的最大长度，用于预先分配解码缓冲区
+ */
+size_t get_base64_decode_length(size_t length)
+{
+	return length / 4 * 3 + 2;
+}
+
+/**
+ * @brief base64编码，标量实现，用于不支持SIMD的平台及SIMD实现剩余的尾部数据
  * @param data 待编码数据
- * @return data被base64编码后的字符串
+ * @param length 待编码数据的长度
+ * @param result 编码结果
+ * @return 编码结果的长度
  */
-std::string get_base64_encode(const std::string &data)
+size_t base64_encode_scalar(const unsigned char *data, size_t length, char *result)
 {
-	typedef boost::archive::iterators::base64_from_binary<boost::archive::iterators::transform_width<std::string::const_iterator, 6, 8>> Base64EncodeIterator;
+	static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	char *p = result;
+	size_t i = 0;
+	for (; i + 3 <= length; i += 3)
+	{
+		unsigned int v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+		*p++ = table[(v >> 18) & 0x3F];
+		*p++ = table[(v >> 12) & 0x3F];
+		*p++ = table[(v >> 6) & 0x3F];
+		*p++ = table[v & 0x3F];
+	}
+	if (i < length)
+	{
+		unsigned int v = data[i] << 16;
+		if (i + 1 < length)
+		{
+			v |= data[i + 1] << 8;
+		}
+		*p++ = table[(v >> 18) & 0x3F];
+		*p++ = table[(v >> 12) & 0x3F];
+		*p++ = i + 1 < length ? table[(v >> 6) & 0x3F] : '=';
+		*p++ = '=';
+	}
+	return p - result;
+}
 
-	std::stringstream result;
+/**
+ * @brief base64解码，标量实现，用于不支持SIMD的平台及SIMD实现剩余的尾部数据
+ * 与原boost实现一致，n个字符解码为n * 3 / 4个字节
+ * @param data 待解码数据，不含末尾的'='
+ * @param length 待解码数据的长度
+ * @param result 解码结果
+ * @return 解码结果的长度，data中含有非base64字符时返回-1
+ */
+long base64_decode_scalar(const char *data, size_t length, unsigned char *result)
+{
+	static const signed char table[256] = {
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+		52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+		-1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+		15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+		-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+		41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
 
-	std::copy(Base64EncodeIterator(data.begin()), Base64EncodeIterator(data.end()), std::ostream_iterator<char>(result));
-	size_t equal_count = (3 - data.length() % 3) % 3;
-	for (size_t i = 0; i < equal_count; i++)
+	unsigned char *p = result;
+	unsigned int v = 0;
+	int bits = 0;
+	for (size_t i = 0; i < length; i++)
 	{
-		result.put('=');
+		int c = table[(unsigned char)data[i]];
+		if (c < 0)
+		{
+			return -1;
+		}
+		v = (v << 6) | c;
+		bits += 6;
+		if (bits >= 8)
+		{
+			bits -= 8;
+			*p++ = (unsigned char)(v >> bits);
+		}
 	}
+	return p - result;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IFLYTEK_BASE64_SIMD
+
+/**
+ * @brief SIMD编码的核心步骤：将每3个字节拆分为4个6位索引，再将索引映射为base64字符
+ * 参考Wojciech Muła, Daniel Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions"
+ */
+__attribute__((target("ssse3"))) inline __m128i base64_encode_block_ssse3(__m128i in)
+{
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	__m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	__m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	__m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	__m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	__m128i indices = _mm_or_si128(t1, t3);
+
+	__m128i offset = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	__m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+	offset = _mm_or_si128(offset, _mm_and_si128(less, _mm_set1_epi8(13)));
+	const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+										'0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	return _mm_add_epi8(_mm_shuffle_epi8(shift, offset), indices);
+}
+
+__attribute__((target("avx2"))) inline __m256i base64_encode_block_avx2(__m256i in)
+{
+	in = _mm256_shuffle_epi8(in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+												 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	__m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+	__m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+	__m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+	__m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+	__m256i indices = _mm256_or_si256(t1, t3);
 
-	return result.str();
+	__m256i offset = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+	__m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+	offset = _mm256_or_si256(offset, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+	const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+										   '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+										   'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+										   '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	return _mm256_add_epi8(_mm256_shuffle_epi8(shift, offset), indices);
 }
 
 /**
- * @brief base64解码算法
- * @param data 待解码数据
- * @return data被base64解码后的字符串
+ * @brief base64编码，SSSE3实现，每次将12个字节编码为16个字符
+ * 每次读取16个字节，因此剩余不足16个字节时交给标量实现
  */
-std::string get_base64_decode(const std::string &data)
+__attribute__((target("ssse3"))) size_t base64_encode_ssse3(const unsigned char *data, size_t length, char *result)
 {
-	typedef boost::archive::iterators::transform_width<boost::archive::iterators::binary_from_base64<std::string::const_iterator>, 8, 6> Base64DecodeIterator;
+	char *p = result;
+	while (length >= 16)
+	{
+		__m128i in = _mm_loadu_si128((const __m128i *)data);
+		_mm_storeu_si128((__m128i *)p, base64_encode_block_ssse3(in));
+		data += 12;
+		length -= 12;
+		p += 16;
+	}
+	return (p - result) + base64_encode_scalar(data, length, p);
+}
 
-	std::stringstream result;
+/**
+ * @brief base64编码，AVX2实现，每次将24个字节编码为32个字符
+ * 两个128位通道分别读取data及data + 12处的16个字节，因此剩余不足28个字节时交给SSSE3实现
+ */
+__attribute__((target("avx2"))) size_t base64_encode_avx2(const unsigned char *data, size_t length, char *result)
+{
+	char *p = result;
+	while (length >= 28)
+	{
+		__m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)data)),
+											 _mm_loadu_si128((const __m128i *)(data + 12)), 1);
+		_mm256_storeu_si256((__m256i *)p, base64_encode_block_avx2(in));
+		data += 24;
+		length -= 24;
+		p += 32;
+	}
+	// 清除ymm寄存器的高128位，避免在之后的SSE代码中产生AVX-SSE切换的性能损失
+	_mm256_zeroupper();
+	return (p - result) + base64_encode_ssse3(data, length, p);
+}
+
+/**
+ * @brief SIMD解码的核心步骤：校验并将base64字符映射为6位数值，再将每4个数值合并为3个字节
+ * 含有非base64字符时valid置为false
+ */
+__attribute__((target("sse4.1"))) inline __m128i base64_decode_block_sse41(__m128i in, bool &valid)
+{
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+										 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+										 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	__m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+	__m128i lo_nibbles = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+	__m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+	__m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+	if (!_mm_testz_si128(lo, hi))
+	{
+		valid = false;
+	}
 
+	__m128i eq_2f = _mm_cmpeq_epi8(in, _mm_set1_epi8(0x2f));
+	__m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+	__m128i values = _mm_add_epi8(in, roll);
+
+	__m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+	merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("avx2"))) inline __m256i base64_decode_block_avx2(__m256i in, bool &valid)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+											0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+											0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+											0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+											0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+											0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+											0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+											  0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	__m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+	__m256i lo_nibbles = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+	__m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+	__m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+	if (!_mm256_testz_si256(lo, hi))
+	{
+		valid = false;
+	}
+
+	__m256i eq_2f = _mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x2f));
+	__m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+	__m256i values = _mm256_add_epi8(in, roll);
+
+	__m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+	merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+	merged = _mm256_shuffle_epi8(merged, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+														  2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	return _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+}
+
+/**
+ * @brief base64解码，SSE4.1实现，每次将16个字符解码为12个字节
+ * 每次写入16个字节，剩余字符不少于32个时解码结果至少还有24个字节，写入不会越过解码结果的末尾
+ */
+__attribute__((target("sse4.1"))) long base64_decode_sse41(const char *data, size_t length, unsigned char *result)
+{
+	unsigned char *p = result;
+	bool valid = true;
+	while (length >= 32)
+	{
+		__m128i in = _mm_loadu_si128((const __m128i *)data);
+		_mm_storeu_si128((__m128i *)p, base64_decode_block_sse41(in, valid));
+		if (!valid)
+		{
+			return -1;
+		}
+		data += 16;
+		length -= 16;
+		p += 12;
+	}
+	long tail = base64_decode_scalar(data, length, p);
+	return tail < 0 ? -1 : (p - result) + tail;
+}
+
+/**
+ * @brief base64解码，AVX2实现，每次将32个字符解码为24个字节
+ * 每次写入32个字节，剩余字符不少于64个时解码结果至少还有48个字节，写入不会越过解码结果的末尾
+ */
+__attribute__((target("avx2"))) long base64_decode_avx2(const char *data, size_t length, unsigned char *result)
+{
+	unsigned char *p = result;
+	bool valid = true;
+	while (length >= 64)
+	{
+		__m256i in = _mm256_loadu_si256((const __m256i *)data);
+		_mm256_storeu_si256((__m256i *)p, base64_decode_block_avx2(in, valid));
+		if (!valid)
+		{
+			return -1;
+		}
+		data += 32;
+		length -= 32;
+		p += 24;
+	}
+	_mm256_zeroupper();
+	long tail = base64_decode_sse41(data, length, p);
+	return tail < 0 ? -1 : (p - result) + tail;
+}
+#endif
+
+/**
+ * @brief 运行时检测CPU支持的SIMD指令集
+ * @return 2表示AVX2，1表示SSE4.1（含SSSE3），0表示只使用标量实现
+ */
+int get_base64_simd_level()
+{
+#ifdef IFLYTEK_BASE64_SIMD
+	static const int level = __builtin_cpu_supports("avx2") ? 2 : (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3") ? 1 : 0);
+	return level;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief base64编码算法，编码结果写入调用者提供的缓冲区，不分配内存
+ * 运行时按CPU支持的指令集选择AVX2、SSSE3或标量实现
+ * @param data 待编码数据
+ * @param length 待编码数据的长度
+ * @param result 编码结果，长度至少为get_base64_encode_length(length)
+ * @return 编码结果的长度
+ */
+size_t get_base64_encode(const unsigned char *data, size_t length, char *result)
+{
+#ifdef IFLYTEK_BASE64_SIMD
+	switch (get_base64_simd_level())
+	{
+	case 2:
+		return base64_encode_avx2(data, length, result);
+	case 1:
+		return base64_encode_ssse3(data, length, result);
+	}
+#endif
+	return base64_encode_scalar(data, length, result);
+}
+
+/**
+ * @brief base64解码算法，解码结果写入调用者提供的缓冲区，不分配内存
+ * 末尾的'='直接跳过，不再复制输入数据
+ * 运行时按CPU支持的指令集选择AVX2、SSE4.1或标量实现
+ * @param data 待解码数据
+ * @param length 待解码数据的长度
+ * @param result 解码结果，长度至少为get_base64_decode_length(length)
+ * @return 解码结果的长度，data中含有非base64字符时返回-1
+ */
+long get_base64_decode(const char *data, size_t length, unsigned char *result)
+{
 	// ******************************************************************************************************
 	// Base64编码原理是把3字节的二进制数据编码为4字节的文本数据，长度增加33%。
 	// 如果要编码的二进制数据不是3的倍数，会在最后剩下1个或2个字节用'\x00'字节在末尾补足，然后在编码的末尾加上1个或2个'='号。
-	// 所以在Base64解码中会将'='号解码为'\0'，这对文本无影响，但是对音频有影响，所以需要手动将'='去除再解码。
+	// 所以在Base64解码中会将'='号解码为'\0'，这对文本无影响，但是对音频有影响，所以需要去除'='再解码。
 	// ******************************************************************************************************
-	std::string temp = data;
-	while (temp[temp.size() - 1] == '=')
+	while (length > 0 && data[length - 1] == '=')
+	{
+		length--;
+	}
+
+#ifdef IFLYTEK_BASE64_SIMD
+	switch (get_base64_simd_level())
+	{
+	case 2:
+		return base64_decode_avx2(data, length, result);
+	case 1:
+		return base64_decode_sse41(data, length, result);
+	}
+#endif
+	return base64_decode_scalar(data, length, result);
+}
+
+/**
+ * @brief base64编码算法
+ * @param data 待编码数据
+ * @param length 待编码数据的长度
+ * @return data被base64编码后的字符串
+ */
+std::string get_base64_encode(const unsigned char *data, size_t length)
+{
+	std::string result(get_base64_encode_length(length), '\0');
+	if (length > 0)
 	{
-		temp.erase(temp.size() - 1);
+		get_base64_encode(data, length, &result[0]);
 	}
+	return result;
+}
 
-	std::copy(Base64DecodeIterator(temp.begin()), Base64DecodeIterator(temp.end()), std::ostream_iterator<char>(result));
+/**
+ * @brief base64编码算法
+ * @param data 待编码数据
+ * @return data被base64编码后的字符串
+ */
+std::string get_base64_encode(const std::string &data)
+{
+	return get_base64_encode((const unsigned char *)data.data(), data.size());
+}
 
-	return result.str();
+/**
+ * @brief base64解码算法
+ * @param data 待解码数据
+ * @return data被base64解码后的字符串，data中含有非base64字符时返回空字符串
+ */
+std::string get_base64_decode(const std::string &data)
+{
+	std::string result(get_base64_decode_length(data.size()), '\0');
+	long length = get_base64_decode(data.data(), data.size(), (unsigned char *)&result[0]);
+	result.resize(length < 0 ? 0 : length);
+	return result;
 }
 
 /**
@@ -117,15 +481,44 @@ std::string get_url_encode(const std::string &url)
 }
 
 /**
- * @brief 延迟函数，Windows和Linux下的延迟函数各异
- * @param t 延迟秒数
+ * @brief url编码算法，编码结果写入调用者提供的缓冲区，不分配内存
+ * 转义规则与get_url_encode(const std::string &)相同
+ * @param data 待编码的数据
+ * @param length 待编码数据的长度
+ * @param result 编码结果，长度至少为length * 3
+ * @return 编码结果的长度
  */
-void delay(double t)
+size_t get_url_encode(const char *data, size_t length, char *result)
 {
-	clock_t start_time = clock();
-	while ((clock() - start_time) < t * CLOCKS_PER_SEC)
+	static const char hex[] = "0123456789ABCDEF";
+
+	char *p = result;
+	for (size_t i = 0; i < length; i++)
 	{
+		unsigned char c = (unsigned char)data[i];
+		// 由于迅飞在解码url时以'='获得参数值，以'&'分割参数，故这两个参数不可转义
+		if (isalnum(c) || c == '&' || c == '=')
+		{
+			*p++ = c;
+		}
+		else
+		{
+			*p++ = '%';
+			*p++ = hex[c >> 4];
+			*p++ = hex[c & 0x0F];
+		}
 	}
+	return p - result;
+}
+
+/**
+ * @brief 延迟函数，按单调时钟的墙上时间休眠，等待期间不占用CPU
+ * 需要按固定间隔连续发送数据时请使用iflytek_pacer，避免每次休眠的误差累积
+ * @param t 延迟秒数
+ */
+void delay(double t)
+{
+	std::this_thread::sleep_until(std::chrono::steady_clock::now() + std::chrono::duration<double>(t));
 }
 
 /**
@@ -135,14 +528,14 @@ void delay(double t)
  */
 std::string get_md5(const std::string &data)
 {
-	unsigned char *result = new unsigned char[20];
+	unsigned char result[MD5_DIGEST_LENGTH];
 
 	MD5_CTX ctx;
 	MD5_Init(&ctx);
 	MD5_Update(&ctx, data.c_str(), data.size());
 	MD5_Final(result, &ctx);
 
-	char *buf = new char[32];
+	char buf[MD5_DIGEST_LENGTH * 2 + 1];
 	for (int i = 0; i < MD5_DIGEST_LENGTH; i++)
 	{
 		sprintf(buf + 2 * i, "%02x", result[i]);
@@ -159,7 +552,7 @@ std::string get_md5(const std::string &data)
  */
 std::string get_hmac_sha1(const std::string &data, const std::string &key)
 {
-	unsigned char *result = new unsigned char[25];
+	unsigned char result[EVP_MAX_MD_SIZE];
 	unsigned int result_len = 0;
 
 	HMAC_CTX *ctx = HMAC_CTX_new();
@@ -2,66 +2,407 @@
  * @Copyright: https://www.xfyun.cn/
  * @Author: iflytek
  * @Data: 2019-12-20
- * 
+ *
  * 本文件包含“讯飞开放平台”的WebAPI接口，发送WebSocket(wss)请求的客户端类定义及实现
  * iflytek_wssclient类基于websocketpp 0.8.1开源框架实现，具体查看：https://github.com/zaphoyd/websocketpp
- * 
+ *
  * iflytek_wssclient类实现了向“讯飞开放平台”服务器发送基于wss的websocket请求
+ * 一个iflytek_wssclient对象共享同一个asio_tls_client，可以在io_service线程池上并发驱动多个iflytek_session会话
+ * 开启连接池后，每个服务预先保持若干个已完成tls握手及websocket升级的连接，新会话可以直接使用
+ * 客户端配置启用了permessage-deflate扩展，调用set_deflate后在握手时协商，上传及接收的json消息按需压缩
+ * 客户端配置使用池化的消息缓冲区，每个连接收发的消息释放后归还到连接的消息池，持续发送音频帧时不再分配消息及负载
  * 如果需要实现ws的websocket请求请参考websoketpp帮助文档：https://www.zaphoyd.com/websocketpp
  */
 
 #ifndef _IFLYTEK_WSSCLIENT_HPP
 #define _IFLYTEK_WSSCLIENT_HPP
 
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include <openssl/ssl.h>
+
 #include "websocketpp/config/asio_client.hpp"
+#include "websocketpp/extensions/permessage_deflate/enabled.hpp"
+#include "websocketpp/message_buffer/pool.hpp"
 #include "websocketpp/client.hpp"
 
-typedef websocketpp::client<websocketpp::config::asio_tls_client> asio_tls_client;
+#include "iflytek_pacer.hpp"
+
+/**
+ * @brief permessage-deflate扩展的协商及压缩参数，由客户端保存，创建连接时传给该连接
+ * @member enable 是否在握手时请求permessage-deflate，服务器不支持时按未压缩通信
+ * @member client_window_bits 客户端压缩窗口的位数（9~15），请求服务器接受的client_max_window_bits
+ * @member server_window_bits 请求服务器使用的压缩窗口位数（9~15），15表示不限制
+ * @member client_context_takeover 客户端是否在消息之间保留压缩上下文，保留时相似的小消息压缩率高得多
+ * @member server_context_takeover 是否允许服务器在消息之间保留压缩上下文
+ * @member level zlib压缩级别（1~9，-1为默认的6），越低越省CPU
+ * @member mem_level zlib内存级别（1~9），压缩器的哈希表占用2^(mem_level+9)字节
+ * @member min_size 小于该字节数的消息不压缩
+ * @member pool_size 缓存的已初始化zlib流数，连接关闭时归还，新连接直接取用，0表示不缓存
+ */
+struct iflytek_deflate_options
+{
+    bool enable;
+    int client_window_bits;
+    int server_window_bits;
+    bool client_context_takeover;
+    bool server_context_takeover;
+    int level;
+    int mem_level;
+    size_t min_size;
+    int pool_size;
+};
+
+/**
+ * @brief 获得默认的permessage-deflate参数，默认不请求permessage-deflate
+ * 上传的音频消息只有一两百字节，压缩率主要来自保留的上下文，客户端默认使用11位窗口和4级内存（每个连接约16KB），压缩率与15位窗口、8级内存相差约1%
+ * @return 默认参数
+ */
+inline iflytek_deflate_options get_default_deflate_options()
+{
+    iflytek_deflate_options options = {false, 11, 15, true, true, Z_DEFAULT_COMPRESSION, 4, 0, 0};
+    return options;
+}
+
+/**
+ * @brief 按连接的参数配置的permessage-deflate扩展
+ * websocketpp的处理器为每个连接默认构造一个扩展对象，创建处理器时由连接调用configure应用该连接的参数
+ *
+ * [public]
+ * @func iflytek_deflate 构造函数，默认不请求permessage-deflate
+ * @func configure 应用连接的协商及压缩参数
+ * @func generate_offer 生成握手请求中的扩展请求，未开启时返回空串，不发送该请求头
+ *
+ * [private]
+ * @member enable 是否在握手时请求permessage-deflate
+ */
+template <typename config>
+class iflytek_deflate : public websocketpp::extensions::permessage_deflate::enabled<config>
+{
+public:
+    iflytek_deflate()
+        : enable(false)
+    {
+    }
+
+    void configure(const iflytek_deflate_options &options)
+    {
+        namespace pmd = websocketpp::extensions::permessage_deflate;
+        this->enable = options.enable;
+        // 服务器在响应中给出的窗口位数只能小于等于请求的值，直接接受
+        this->set_client_max_window_bits(options.client_window_bits, pmd::mode::accept);
+        this->set_server_max_window_bits(options.server_window_bits, pmd::mode::accept);
+        if (!options.client_context_takeover)
+        {
+            this->enable_client_no_context_takeover();
+        }
+        if (!options.server_context_takeover)
+        {
+            this->enable_server_no_context_takeover();
+        }
+        this->set_compression_level(options.level);
+        this->set_memory_level(options.mem_level);
+        this->set_min_compress_size(options.min_size);
+    }
+
+    std::string generate_offer() const
+    {
+        return this->enable ? websocketpp::extensions::permessage_deflate::enabled<config>::generate_offer() : std::string();
+    }
+
+private:
+    bool enable;
+};
+
+/**
+ * @brief 连接的基类，保存该连接的permessage-deflate参数，websocketpp创建处理器时据此配置扩展
+ *
+ * [public]
+ * @func iflytek_connection_base 构造函数，使用默认参数
+ * @func set_deflate_options 设置该连接的参数，需要在发起连接之前调用
+ * @func init_permessage_deflate 创建处理器时配置其扩展对象
+ *
+ * [private]
+ * @member deflate_options 该连接的协商及压缩参数
+ */
+class iflytek_connection_base : public websocketpp::connection_base
+{
+public:
+    iflytek_connection_base()
+        : deflate_options(get_default_deflate_options())
+    {
+    }
+
+    void set_deflate_options(const iflytek_deflate_options &options)
+    {
+        this->deflate_options = options;
+    }
+
+    template <typename extension>
+    void init_permessage_deflate(extension &ext) const
+    {
+        ext.configure(this->deflate_options);
+    }
+
+private:
+    iflytek_deflate_options deflate_options;
+};
+
+/**
+ * @brief 客户端配置，在asio_tls_client的基础上启用按连接配置的permessage-deflate扩展，并使用池化的消息缓冲区
+ */
+struct iflytek_client_config : public websocketpp::config::asio_tls_client
+{
+    typedef iflytek_client_config type;
+
+    typedef iflytek_connection_base connection_base;
+
+    typedef websocketpp::message_buffer::message<websocketpp::message_buffer::pool::con_msg_manager> message_type;
+    typedef websocketpp::message_buffer::pool::con_msg_manager<message_type> con_msg_manager_type;
+    typedef websocketpp::message_buffer::pool::endpoint_msg_manager<con_msg_manager_type> endpoint_msg_manager_type;
+
+    typedef iflytek_deflate<permessage_deflate_config> permessage_deflate_type;
+};
+
+typedef websocketpp::client<iflytek_client_config> asio_tls_client;
 typedef websocketpp::lib::shared_ptr<websocketpp::lib::asio::ssl::context> context_ptr;
 
 /**
- * @brief 进行websocket通信的wss客户端
- * 
+ * @brief 一次websocket会话（一个连接）的状态及业务逻辑
+ * 每个会话对象独立保存自己的帧计数、sid、识别结果等状态，多个会话之间互不影响
+ *
+ * [public]
+ * @func iflytek_session 构造函数
+ * @func get_id 获得会话编号
+ * @func is_success 会话是否成功完成
+ * @func get_url [纯虚函数]获得建立连接的鉴权url
+ * @func send_data [纯虚函数]向服务器发送一帧数据，返回距发送下一帧的毫秒数，返回-1表示发送结束
+ * @func on_message [纯虚函数]websocket收到服务器数据时的回调函数
+ * 注：send_data和on_message都在该连接的strand上执行，同一会话的回调不会并发执行
+ *
+ * [protected]
+ * @func close 客户端主动关闭连接
+ * @member wssclient 会话所属的websocketpp的client对象，由iflytek_wssclient在启动会话时设置
+ * @member id 会话编号，由iflytek_wssclient在添加会话时分配
+ * @member success 会话是否成功完成，由派生类在收到最终结果时设置
+ * @member send_deadline 发送下一帧的绝对截止时间，由iflytek_wssclient按send_data的返回值累加
+ */
+class iflytek_session
+{
+public:
+    iflytek_session();
+    virtual ~iflytek_session() {}
+    int get_id() const;
+    bool is_success() const;
+
+    // 派生类需要重载如下成员函数
+    virtual std::string get_url() = 0;
+    virtual int send_data(websocketpp::connection_hdl hdl) = 0;
+    virtual void on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg) = 0;
+
+protected:
+    void close(websocketpp::connection_hdl hdl, const std::string &reason);
+
+    asio_tls_client *wssclient;
+    int id;
+    bool success;
+    iflytek_pacer::time_point send_deadline;
+
+    friend class iflytek_wssclient;
+};
+
+typedef websocketpp::lib::shared_ptr<iflytek_session> session_ptr;
+
+/**
+ * @brief 连接池中的一个连接
+ * 连接的事件回调绑定到该对象，交给会话之前由连接池处理，交给会话之后转发给会话
+ * @member key 连接所属的服务，即鉴权url去掉查询参数的部分
+ * @member hdl 连接的句柄
+ * @member session 使用该连接的会话，空闲时为空
+ */
+struct iflytek_pooled_connection
+{
+    std::string key;
+    websocketpp::connection_hdl hdl;
+    session_ptr session;
+};
+
+typedef websocketpp::lib::shared_ptr<iflytek_pooled_connection> pooled_ptr;
+
+/**
+ * @brief 进行websocket通信的wss客户端，即会话管理器
+ * 所有会话共享同一个asio_tls_client，由thread_count个线程共同运行其io_service
+ *
  * [public]
  * @func iflytek_wssclient 构造函数
- * @func run_client 运行客户端
- * 
+ * @func add_session 添加一个待运行的会话
+ * @func run_client 运行客户端，直到所有会话结束
+ * @func get_success_count 获得成功完成的会话数
+ * @func get_fail_count 获得失败的会话数
+ * @func get_resumed_count 获得复用tls会话（简化握手）的连接数
+ * @func get_full_handshake_count 获得进行完整tls握手的连接数
+ * @func set_pool 开启连接池，设置每个服务保持的空闲连接数及空闲连接的最长保留时间
+ * @func warm_pool 按会话所属的服务预先建立连接池中的连接，不运行该会话
+ * @func set_deflate 设置permessage-deflate的协商及压缩参数
+ *
  * [protected]
+ * @func start_session 为会话创建连接并发起连接请求
+ * @func end_session 会话结束，启动下一个等待中的会话
+ * @func schedule_send 在节拍器上登记会话下一帧的截止时间
+ * @func wake_session 截止时间到达时，唤醒连接的strand
+ * @func on_interrupt 在连接的strand上发送下一帧的回调函数
  * @func on_open websocket处于已连接状态时的回调函数
  * @func on_close websocket处于关闭状态时的回调函数
  * @func on_fail websocket发生错误时的回调函数
- * @func context_ptr tls初始化，用于wss
- * @func get_url [纯虚函数]获得建立连接的鉴权url
- * @func send_data [纯虚函数]向服务器发送数据
- * @func on_message [纯虚函数]websocket收到服务器数据时的回调函数
+ * @func pool_key 获得鉴权url所属的服务
+ * @func take_pooled 为会话取出连接池中已就绪的连接
+ * @func fill_pool 补足服务的连接池
+ * @func drain_pool 所有会话结束时关闭连接池中的空闲连接
+ * @func expire_pooled 空闲连接到达最长保留时间时的回调函数，关闭后以新的鉴权url重建
+ * @func on_pool_open, on_pool_close, on_pool_fail, on_pool_message, on_pool_interrupt 连接池中连接的回调函数
+ * @func resume_tls_session 为连接设置同一主机上次缓存的tls会话
+ * @func tls_ex_index 获得在ssl上下文中保存客户端指针的扩展数据索引
+ * @func on_new_tls_session 握手得到新的tls会话时的回调函数，按主机缓存该会话
+ * @func build_tls_context 创建所有连接共享的ssl上下文
+ * @func on_tls_init tls初始化，用于wss，返回共享的ssl上下文
  * @member wssclient websocketpp的client对象
+ * @member pacer 所有会话共享的节拍器
+ * @member thread_count 运行io_service的线程数
+ * @member max_concurrency 同时运行的最大会话数，0表示不限制
+ * @member pending 等待运行的会话队列
+ * @member running 正在运行的会话数
+ * @member session_count 已添加的会话总数，用于分配会话编号
+ * @member success_count, fail_count 成功/失败的会话数
+ * @member tls_context 所有连接共享的ssl上下文，只在构造时创建一次
+ * @member tls_sessions 按主机缓存的tls会话，用于下次连接时的会话复用
+ * @member resumed_count, full_handshake_count 复用tls会话/完整握手的连接数
+ * @member pool_size 每个服务保持的空闲连接数，0表示不使用连接池
+ * @member max_idle 空闲连接的最长保留时间（毫秒），需小于服务器的空闲超时时间
+ * @member pools 按服务保存的连接池
+ * @member deflate_options 创建连接时传给每个连接的permessage-deflate参数
+ * @member closing 所有会话已结束，不再补充连接池
+ * @member lock 保护上述会话状态的互斥锁
  */
 class iflytek_wssclient
 {
 public:
-    iflytek_wssclient();
+    iflytek_wssclient(int thread_count = 1, int max_concurrency = 0);
+    void add_session(session_ptr session);
     void run_client();
+    int get_success_count();
+    int get_fail_count();
+    int get_resumed_count();
+    int get_full_handshake_count();
+    void set_pool(int pool_size, long max_idle = 5000);
+    void warm_pool(session_ptr session);
+    void set_deflate(const iflytek_deflate_options &options);
+    ~iflytek_wssclient();
 
 protected:
-    void on_open(websocketpp::connection_hdl hdl);
-    void on_close(websocketpp::connection_hdl hdl);
-    void on_fail(websocketpp::connection_hdl hdl);
-    static context_ptr on_tls_init();
-
-    // 派生类需要重载如下成员函数
-    virtual std::string get_url() = 0;
-    virtual void send_data(websocketpp::connection_hdl hdl) = 0;
-    virtual void on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg) = 0;
+    void start_session(session_ptr session);
+    void end_session(session_ptr session);
+    void schedule_send(session_ptr session, websocketpp::connection_hdl hdl);
+    void wake_session(websocketpp::connection_hdl hdl);
+    void on_interrupt(session_ptr session, websocketpp::connection_hdl hdl);
+    void on_open(session_ptr session, websocketpp::connection_hdl hdl);
+    void on_close(session_ptr session, websocketpp::connection_hdl hdl);
+    void on_fail(session_ptr session, websocketpp::connection_hdl hdl);
+    static std::string pool_key(const std::string &url);
+    bool take_pooled(session_ptr session, const std::string &url);
+    void fill_pool(const std::string &key);
+    void drain_pool();
+    void expire_pooled(pooled_ptr pooled);
+    void on_pool_open(pooled_ptr pooled, websocketpp::connection_hdl hdl);
+    void on_pool_close(pooled_ptr pooled, websocketpp::connection_hdl hdl);
+    void on_pool_fail(pooled_ptr pooled, websocketpp::connection_hdl hdl);
+    void on_pool_message(pooled_ptr pooled, websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg);
+    void on_pool_interrupt(pooled_ptr pooled, websocketpp::connection_hdl hdl);
+    void resume_tls_session(asio_tls_client::connection_ptr con);
+    static int tls_ex_index();
+    static int on_new_tls_session(SSL *ssl, SSL_SESSION *tls_session);
+    context_ptr build_tls_context();
+    context_ptr on_tls_init();
 
     asio_tls_client wssclient;
+    websocketpp::lib::shared_ptr<iflytek_pacer> pacer;
+
+private:
+    int thread_count, max_concurrency;
+    std::deque<session_ptr> pending;
+    int running, session_count, success_count, fail_count;
+    context_ptr tls_context;
+    std::map<std::string, SSL_SESSION *> tls_sessions;
+    int resumed_count, full_handshake_count;
+
+    struct connection_pool
+    {
+        websocketpp::lib::function<std::string()> get_url;
+        std::deque<pooled_ptr> ready;
+        int connecting;
+    };
+    int pool_size;
+    long max_idle;
+    std::map<std::string, connection_pool> pools;
+    iflytek_deflate_options deflate_options;
+    bool closing;
+    websocketpp::lib::mutex lock;
 };
 
+/**
+ * @brief 构造函数
+ */
+iflytek_session::iflytek_session()
+    : wssclient(NULL), id(0), success(false)
+{
+}
+
+/**
+ * @brief 获得会话编号
+ * @return 会话编号
+ */
+int iflytek_session::get_id() const
+{
+    return this->id;
+}
+
+/**
+ * @brief 会话是否成功完成
+ * @return 成功完成时返回true
+ */
+bool iflytek_session::is_success() const
+{
+    return this->success;
+}
+
+/**
+ * @brief 客户端主动关闭连接
+ * @param hdl 当前连接的句柄
+ * @param reason 关闭原因
+ */
+void iflytek_session::close(websocketpp::connection_hdl hdl, const std::string &reason)
+{
+    websocketpp::lib::error_code ec;
+    asio_tls_client::connection_ptr con = this->wssclient->get_con_from_hdl(hdl, ec);
+    if (!ec && con != NULL && con->get_state() == websocketpp::session::state::value::open)
+    {
+        con->close(0, reason, ec);
+    }
+}
+
 /**
  * @brief 构造函数
  * 进行相关设置初始化
  * 绑定回调函数
+ * @param thread_count 运行io_service的线程数
+ * @param max_concurrency 同时运行的最大会话数，0表示不限制
  */
-iflytek_wssclient::iflytek_wssclient()
+iflytek_wssclient::iflytek_wssclient(int thread_count, int max_concurrency)
+    : thread_count(thread_count < 1 ? 1 : thread_count), max_concurrency(max_concurrency),
+      running(0), session_count(0), success_count(0), fail_count(0),
+      resumed_count(0), full_handshake_count(0), pool_size(0), max_idle(5000),
+      deflate_options(get_default_deflate_options()), closing(false)
 {
     // 开启/关闭相关日志
     // this->wssclient.set_access_channels(websocketpp::log::alevel::all);
@@ -71,91 +412,722 @@ iflytek_wssclient::iflytek_wssclient()
 
     // 初始化Asio
     this->wssclient.init_asio();
+    this->pacer = websocketpp::lib::make_shared<iflytek_pacer>(websocketpp::lib::ref(this->wssclient.get_io_service()));
 
-    // 绑定事件
+    // 绑定事件，open/close/fail/message事件在start_session中按连接绑定到各自的会话
     using websocketpp::lib::bind;
-    using websocketpp::lib::placeholders::_1;
-    using websocketpp::lib::placeholders::_2;
-    this->wssclient.set_open_handler(bind(&iflytek_wssclient::on_open, this, _1));
-    this->wssclient.set_close_handler(bind(&iflytek_wssclient::on_close, this, _1));
-    this->wssclient.set_fail_handler(bind(&iflytek_wssclient::on_fail, this, _1));
-    this->wssclient.set_message_handler(bind(&iflytek_wssclient::on_message, this, _1, _2));
-    this->wssclient.set_tls_init_handler(bind(&iflytek_wssclient::on_tls_init)); // tls初始化，用于wss
+    this->tls_context = this->build_tls_context();
+    this->wssclient.set_tls_init_handler(bind(&iflytek_wssclient::on_tls_init, this)); // tls初始化，用于wss
+}
+
+/**
+ * @brief 析构函数
+ * 释放缓存的tls会话
+ */
+iflytek_wssclient::~iflytek_wssclient()
+{
+    std::map<std::string, SSL_SESSION *>::iterator it;
+    for (it = this->tls_sessions.begin(); it != this->tls_sessions.end(); ++it)
+    {
+        SSL_SESSION_free(it->second);
+    }
+}
+
+/**
+ * @brief 添加一个待运行的会话
+ * 可以在run_client之前或运行过程中（例如在回调函数中）调用
+ * @param session 会话
+ */
+void iflytek_wssclient::add_session(session_ptr session)
+{
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        session->id = this->session_count++;
+        session->wssclient = &this->wssclient;
+        this->closing = false;
+        if (this->max_concurrency > 0 && this->running >= this->max_concurrency)
+        {
+            this->pending.push_back(session);
+            return;
+        }
+        this->running++;
+    }
+    this->start_session(session);
 }
 
 /**
  * @brief 运行客户端
+ * thread_count个线程共同运行io_service，直到所有会话结束
+ */
+void iflytek_wssclient::run_client()
+{
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        if (this->running == 0 && this->pending.empty())
+        {
+            return;
+        }
+        // 保持io_service运行，直到最后一个会话结束时调用stop_perpetual
+        this->wssclient.start_perpetual();
+    }
+
+    std::vector<websocketpp::lib::shared_ptr<websocketpp::lib::thread>> threads;
+    for (int i = 1; i < this->thread_count; i++)
+    {
+        threads.push_back(websocketpp::lib::make_shared<websocketpp::lib::thread>(&asio_tls_client::run, &this->wssclient));
+    }
+    this->wssclient.run();
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i]->join();
+    }
+
+    fprintf(stdout, "[INFO] All sessions finished, %d succeeded, %d failed\n", this->get_success_count(), this->get_fail_count());
+    fprintf(stdout, "[INFO] TLS handshakes: %d resumed, %d full\n", this->get_resumed_count(), this->get_full_handshake_count());
+}
+
+/**
+ * @brief 获得成功完成的会话数
+ * @return 成功完成的会话数
+ */
+int iflytek_wssclient::get_success_count()
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+    return this->success_count;
+}
+
+/**
+ * @brief 获得失败的会话数
+ * @return 失败的会话数
+ */
+int iflytek_wssclient::get_fail_count()
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+    return this->fail_count;
+}
+
+/**
+ * @brief 获得复用tls会话（简化握手）的连接数
+ * @return 复用tls会话的连接数
+ */
+int iflytek_wssclient::get_resumed_count()
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+    return this->resumed_count;
+}
+
+/**
+ * @brief 获得进行完整tls握手的连接数
+ * @return 完整握手的连接数
+ */
+int iflytek_wssclient::get_full_handshake_count()
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+    return this->full_handshake_count;
+}
+
+/**
+ * @brief 开启连接池
+ * 需要在添加会话之前调用
+ * @param pool_size 每个服务保持的空闲连接数，0表示不使用连接池
+ * @param max_idle 空闲连接的最长保留时间（毫秒），到期后以新的鉴权url重建，
+ *                 需小于服务器的空闲超时时间，同时保证鉴权url中的date不会过期
+ */
+void iflytek_wssclient::set_pool(int pool_size, long max_idle)
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+    this->pool_size = pool_size < 0 ? 0 : pool_size;
+    this->max_idle = max_idle;
+}
+
+/**
+ * @brief 设置permessage-deflate的协商及压缩参数
+ * 需要在添加会话之前调用，此后该客户端创建的连接使用这些参数；缓存的zlib流数对所有客户端生效
+ * @param options 协商及压缩参数，enable为false时不请求permessage-deflate
+ */
+void iflytek_wssclient::set_deflate(const iflytek_deflate_options &options)
+{
+    this->deflate_options = options;
+    websocketpp::extensions::permessage_deflate::stream_pool::get_instance().set_max_idle(options.pool_size < 0 ? 0 : options.pool_size);
+}
+
+/**
+ * @brief 按会话所属的服务预先建立连接池中的连接，不运行该会话
+ * 该会话之后用于生成该服务的鉴权url
+ * @param session 用于生成鉴权url的会话
+ */
+void iflytek_wssclient::warm_pool(session_ptr session)
+{
+    std::string key = pool_key(session->get_url());
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        if (this->pool_size == 0)
+        {
+            return;
+        }
+        session->wssclient = &this->wssclient;
+        this->closing = false;
+        connection_pool &pool = this->pools[key];
+        if (!pool.get_url)
+        {
+            pool.connecting = 0;
+            pool.get_url = websocketpp::lib::bind(&iflytek_session::get_url, session);
+        }
+    }
+    this->fill_pool(key);
+}
+
+/**
+ * @brief 为会话创建连接并发起连接请求
  * 获取鉴权url
  * 与该url建立wss通信
+ * @param session 会话
  */
-void iflytek_wssclient::run_client()
+void iflytek_wssclient::start_session(session_ptr session)
 {
-    fprintf(stdout, "[INFO] WebSocket's STATE is ON_CONNECT...\n");
+    fprintf(stdout, "[INFO] Session %d: WebSocket's STATE is ON_CONNECT...\n", session->id);
     // 获取鉴权url
-    std::string url = this->get_url();
-    fprintf(stdout, "[INFO] Authorization_URL is \"%s\"\n", url.c_str());
+    std::string url = session->get_url();
+    fprintf(stdout, "[INFO] Session %d: Authorization_URL is \"%s\"\n", session->id, url.c_str());
+
+    // 优先使用连接池中已就绪的连接
+    if (this->pool_size > 0 && this->take_pooled(session, url))
+    {
+        return;
+    }
 
     // 创建一个新的连接请求
     websocketpp::lib::error_code ec;
     asio_tls_client::connection_ptr con = this->wssclient.get_connection(url, ec);
     if (ec)
     {
-        fprintf(stderr, "[ERROR] Failed to connect: \"%s\"\n", ec.message().c_str());
-        exit(1);
+        fprintf(stderr, "[ERROR] Session %d: Failed to connect: \"%s\"\n", session->id, ec.message().c_str());
+        this->end_session(session);
+        return;
     }
+    con->set_deflate_options(this->deflate_options);
+
+    // 按连接绑定事件，连接持有会话的引用，直到连接被销毁
+    using websocketpp::lib::bind;
+    using websocketpp::lib::placeholders::_1;
+    using websocketpp::lib::placeholders::_2;
+    con->set_open_handler(bind(&iflytek_wssclient::on_open, this, session, _1));
+    con->set_close_handler(bind(&iflytek_wssclient::on_close, this, session, _1));
+    con->set_fail_handler(bind(&iflytek_wssclient::on_fail, this, session, _1));
+    con->set_message_handler(bind(&iflytek_session::on_message, session, _1, _2));
+    con->set_interrupt_handler(bind(&iflytek_wssclient::on_interrupt, this, session, _1));
+
+    // 复用同一主机上次的tls会话，省去一次往返及非对称加密运算
+    this->resume_tls_session(con);
 
     // 连接到url
     this->wssclient.connect(con);
-    // 运行
-    this->wssclient.run();
+}
+
+/**
+ * @brief 会话结束
+ * 统计会话结果，启动下一个等待中的会话，所有会话结束后停止io_service
+ * @param session 结束的会话
+ */
+void iflytek_wssclient::end_session(session_ptr session)
+{
+    session_ptr next;
+    bool finished = false;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        if (session->success)
+        {
+            this->success_count++;
+        }
+        else
+        {
+            this->fail_count++;
+        }
+
+        if (!this->pending.empty())
+        {
+            next = this->pending.front();
+            this->pending.pop_front();
+        }
+        else if (--this->running == 0)
+        {
+            this->closing = finished = true;
+        }
+    }
+    if (next)
+    {
+        this->start_session(next);
+    }
+    else if (finished)
+    {
+        // 所有会话结束，关闭空闲连接后停止io_service
+        this->drain_pool();
+        this->wssclient.stop_perpetual();
+    }
+}
+
+/**
+ * @brief 在节拍器上登记会话下一帧的截止时间
+ * 所有会话共享节拍器的一个定时器，等待期间不占用线程
+ * @param session 当前连接所属的会话
+ * @param hdl 当前连接的句柄
+ */
+void iflytek_wssclient::schedule_send(session_ptr session, websocketpp::connection_hdl hdl)
+{
+    this->pacer->schedule(session->send_deadline, websocketpp::lib::bind(&iflytek_wssclient::wake_session, this, hdl));
+}
+
+/**
+ * @brief 截止时间到达时，唤醒连接的strand
+ * 在节拍器的线程上执行，通过interrupt将发送转交到连接的strand
+ * @param hdl 当前连接的句柄
+ */
+void iflytek_wssclient::wake_session(websocketpp::connection_hdl hdl)
+{
+    websocketpp::lib::error_code ec;
+    asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl, ec);
+    if (ec)
+    {
+        // 连接已销毁，停止发送
+        return;
+    }
+    con->interrupt();
+}
+
+/**
+ * @brief 在连接的strand上发送下一帧的回调函数
+ * 发送一帧数据，下一帧的截止时间为本帧的截止时间加上会话返回的间隔，
+ * 因此发送耗时和调度延迟不会累积到后续帧上
+ * @param session 当前连接所属的会话
+ * @param hdl 当前连接的句柄
+ */
+void iflytek_wssclient::on_interrupt(session_ptr session, websocketpp::connection_hdl hdl)
+{
+    websocketpp::lib::error_code ec;
+    asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl, ec);
+    if (ec || con->get_state() != websocketpp::session::state::value::open)
+    {
+        // 连接已关闭，停止发送
+        return;
+    }
+
+    int interval = session->send_data(hdl);
+    if (interval >= 0)
+    {
+        session->send_deadline += websocketpp::lib::chrono::milliseconds(interval);
+        this->schedule_send(session, hdl);
+    }
 }
 
 /**
  * @brief websocket处于已连接状态时的回调函数
- * 开启线程，向服务器发送数据
+ * 在连接的strand上开始向服务器发送数据
+ * @param session 当前连接所属的会话
  * @param hdl 当前连接的句柄
  */
-void iflytek_wssclient::on_open(websocketpp::connection_hdl hdl)
+void iflytek_wssclient::on_open(session_ptr session, websocketpp::connection_hdl hdl)
 {
-    fprintf(stdout, "[INFO] WebSocket's STATE is ON_OPEN...\n");
+    fprintf(stdout, "[INFO] Session %d: WebSocket's STATE is ON_OPEN...\n", session->id);
 
-    // 开启线程，向服务器发送数据
-    websocketpp::lib::thread send_data_thread(&iflytek_wssclient::send_data, this, hdl);
-    send_data_thread.detach();
+    // 统计tls握手类型
+    websocketpp::lib::error_code ec;
+    asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl, ec);
+    if (ec)
+    {
+        return;
+    }
+    bool resumed = SSL_session_reused(con->get_socket().native_handle()) == 1;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        if (resumed)
+        {
+            this->resumed_count++;
+        }
+        else
+        {
+            this->full_handshake_count++;
+        }
+    }
+
+    // 立即发送第一帧，后续帧的截止时间以此为起点
+    session->send_deadline = iflytek_pacer::now();
+    this->schedule_send(session, hdl);
 }
 
 /**
  * @brief websocket处于关闭状态时的回调函数
+ * @param session 当前连接所属的会话
  * @param hdl 当前连接的句柄
  */
-void iflytek_wssclient::on_close(websocketpp::connection_hdl hdl)
+void iflytek_wssclient::on_close(session_ptr session, websocketpp::connection_hdl hdl)
 {
-    fprintf(stdout, "[INFO] WebSocket's STATE is ON_CLOSE...\n");
+    fprintf(stdout, "[INFO] Session %d: WebSocket's STATE is ON_CLOSE...\n", session->id);
 
     // asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl);
     // cout << "[INFO] [websocketpp info] " << con->get_ec() << "-" << con->get_ec().message() << endl;
+    this->end_session(session);
 }
 
 /**
  * @brief websocket发生错误时的回调函数
- * 输出相关错误日志
+ * 输出相关错误日志，该会话记为失败，不影响其他会话
+ * @param session 当前连接所属的会话
  * @param hdl 当前连接的句柄
  */
-void iflytek_wssclient::on_fail(websocketpp::connection_hdl hdl)
+void iflytek_wssclient::on_fail(session_ptr session, websocketpp::connection_hdl hdl)
 {
-    fprintf(stdout, "[INFO] WebSocket's STATE is ON_FAIL...\n");
+    fprintf(stdout, "[INFO] Session %d: WebSocket's STATE is ON_FAIL...\n", session->id);
 
     asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl);
-    std::cout << "[ERROR] [websocketpp info] " << con->get_ec() << "-" << con->get_ec().message() << std::endl;
-    std::cout << "[ERROR] [server info] " << con->get_response_code() << "-" << con->get_response_msg() << std::endl;
-    exit(1);
+    std::cout << "[ERROR] Session " << session->id << ": [websocketpp info] " << con->get_ec() << "-" << con->get_ec().message() << std::endl;
+    std::cout << "[ERROR] Session " << session->id << ": [server info] " << con->get_response_code() << "-" << con->get_response_msg() << std::endl;
+    session->success = false;
+    this->end_session(session);
 }
 
 /**
- * @brief tls初始化，用于wss
- * @return ssl句柄
+ * @brief 获得鉴权url所属的服务
+ * @param url 鉴权url
+ * @return 去掉查询参数（鉴权参数）的url
  */
-context_ptr iflytek_wssclient::on_tls_init()
+std::string iflytek_wssclient::pool_key(const std::string &url)
+{
+    return url.substr(0, url.find('?'));
+}
+
+/**
+ * @brief 为会话取出连接池中已就绪的连接
+ * 取出后补足该服务的连接池，没有就绪的连接时由调用者新建连接
+ * @param session 会话
+ * @param url 会话的鉴权url
+ * @return 取到已就绪的连接时返回true
+ */
+bool iflytek_wssclient::take_pooled(session_ptr session, const std::string &url)
+{
+    std::string key = pool_key(url);
+    pooled_ptr pooled;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        connection_pool &pool = this->pools[key];
+        if (!pool.get_url)
+        {
+            pool.connecting = 0;
+            pool.get_url = websocketpp::lib::bind(&iflytek_session::get_url, session);
+        }
+        while (!pool.ready.empty() && !pooled)
+        {
+            pooled = pool.ready.front();
+            pool.ready.pop_front();
+
+            // 跳过已被服务器关闭的连接
+            websocketpp::lib::error_code ec;
+            asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(pooled->hdl, ec);
+            if (ec || con->get_state() != websocketpp::session::state::value::open)
+            {
+                pooled.reset();
+                continue;
+            }
+            pooled->session = session;
+        }
+    }
+    this->fill_pool(key);
+
+    if (!pooled)
+    {
+        return false;
+    }
+    fprintf(stdout, "[INFO] Session %d: Using a warm connection from the pool\n", session->id);
+    this->on_open(session, pooled->hdl);
+    return true;
+}
+
+/**
+ * @brief 补足服务的连接池
+ * 就绪及正在建立的连接数不足pool_size时，以新的鉴权url建立连接
+ * @param key 服务
+ */
+void iflytek_wssclient::fill_pool(const std::string &key)
+{
+    int need;
+    websocketpp::lib::function<std::string()> get_url;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        connection_pool &pool = this->pools[key];
+        need = this->pool_size - (int)pool.ready.size() - pool.connecting;
+        if (this->closing || need <= 0 || !pool.get_url)
+        {
+            return;
+        }
+        pool.connecting += need;
+        get_url = pool.get_url;
+    }
+
+    using websocketpp::lib::bind;
+    using websocketpp::lib::placeholders::_1;
+    using websocketpp::lib::placeholders::_2;
+    for (int i = 0; i < need; i++)
+    {
+        websocketpp::lib::error_code ec;
+        asio_tls_client::connection_ptr con = this->wssclient.get_connection(get_url(), ec);
+        if (ec)
+        {
+            fprintf(stderr, "[ERROR] Failed to connect a pooled connection: \"%s\"\n", ec.message().c_str());
+            websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+            this->pools[key].connecting--;
+            continue;
+        }
+        con->set_deflate_options(this->deflate_options);
+
+        pooled_ptr pooled = websocketpp::lib::make_shared<iflytek_pooled_connection>();
+        pooled->key = key;
+        pooled->hdl = con->get_handle();
+        con->set_open_handler(bind(&iflytek_wssclient::on_pool_open, this, pooled, _1));
+        con->set_close_handler(bind(&iflytek_wssclient::on_pool_close, this, pooled, _1));
+        con->set_fail_handler(bind(&iflytek_wssclient::on_pool_fail, this, pooled, _1));
+        con->set_message_handler(bind(&iflytek_wssclient::on_pool_message, this, pooled, _1, _2));
+        con->set_interrupt_handler(bind(&iflytek_wssclient::on_pool_interrupt, this, pooled, _1));
+        this->resume_tls_session(con);
+        this->wssclient.connect(con);
+    }
+}
+
+/**
+ * @brief 所有会话结束时关闭连接池中的空闲连接
+ * 同时清空节拍器，使io_service可以退出
+ */
+void iflytek_wssclient::drain_pool()
+{
+    std::vector<pooled_ptr> idle;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        std::map<std::string, connection_pool>::iterator it;
+        for (it = this->pools.begin(); it != this->pools.end(); ++it)
+        {
+            idle.insert(idle.end(), it->second.ready.begin(), it->second.ready.end());
+            it->second.ready.clear();
+        }
+    }
+
+    for (size_t i = 0; i < idle.size(); i++)
+    {
+        websocketpp::lib::error_code ec;
+        asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(idle[i]->hdl, ec);
+        if (!ec && con->get_state() == websocketpp::session::state::value::open)
+        {
+            con->close(websocketpp::close::status::normal, "idle", ec);
+        }
+    }
+    this->pacer->clear();
+}
+
+/**
+ * @brief 空闲连接到达最长保留时间时的回调函数
+ * 连接仍空闲时将其关闭，关闭后由on_pool_close以新的鉴权url重建
+ * @param pooled 连接池中的连接
+ */
+void iflytek_wssclient::expire_pooled(pooled_ptr pooled)
+{
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        std::deque<pooled_ptr> &ready = this->pools[pooled->key].ready;
+        std::deque<pooled_ptr>::iterator it = std::find(ready.begin(), ready.end(), pooled);
+        if (it == ready.end())
+        {
+            // 已交给会话或已关闭
+            return;
+        }
+        ready.erase(it);
+    }
+
+    websocketpp::lib::error_code ec;
+    asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(pooled->hdl, ec);
+    if (!ec && con->get_state() == websocketpp::session::state::value::open)
+    {
+        con->close(websocketpp::close::status::normal, "idle", ec);
+    }
+}
+
+/**
+ * @brief 连接池中的连接处于已连接状态时的回调函数
+ * 将连接放入就绪队列，并在max_idle毫秒后检查是否仍空闲
+ * @param pooled 连接池中的连接
+ * @param hdl 当前连接的句柄
+ */
+void iflytek_wssclient::on_pool_open(pooled_ptr pooled, websocketpp::connection_hdl hdl)
+{
+    bool closing;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        connection_pool &pool = this->pools[pooled->key];
+        pool.connecting--;
+        closing = this->closing;
+        if (!closing)
+        {
+            pool.ready.push_back(pooled);
+        }
+    }
+
+    if (closing)
+    {
+        websocketpp::lib::error_code ec;
+        this->wssclient.close(hdl, websocketpp::close::status::normal, "idle", ec);
+        return;
+    }
+    this->pacer->schedule(iflytek_pacer::now() + websocketpp::lib::chrono::milliseconds(this->max_idle),
+                          websocketpp::lib::bind(&iflytek_wssclient::expire_pooled, this, pooled));
+}
+
+/**
+ * @brief 连接池中的连接处于关闭状态时的回调函数
+ * 已交给会话的连接转发给会话，空闲连接被关闭时补足连接池
+ * @param pooled 连接池中的连接
+ * @param hdl 当前连接的句柄
+ */
+void iflytek_wssclient::on_pool_close(pooled_ptr pooled, websocketpp::connection_hdl hdl)
+{
+    session_ptr session;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        session = pooled->session;
+        if (!session)
+        {
+            std::deque<pooled_ptr> &ready = this->pools[pooled->key].ready;
+            std::deque<pooled_ptr>::iterator it = std::find(ready.begin(), ready.end(), pooled);
+            if (it != ready.end())
+            {
+                ready.erase(it);
+            }
+        }
+    }
+
+    if (session)
+    {
+        this->on_close(session, hdl);
+        return;
+    }
+    this->fill_pool(pooled->key);
+}
+
+/**
+ * @brief 连接池中的连接发生错误时的回调函数
+ * 连接失败时不立即重建，避免服务不可用时反复重连，由下一个会话补足连接池
+ * @param pooled 连接池中的连接
+ * @param hdl 当前连接的句柄
+ */
+void iflytek_wssclient::on_pool_fail(pooled_ptr pooled, websocketpp::connection_hdl hdl)
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+    this->pools[pooled->key].connecting--;
+
+    asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl);
+    fprintf(stderr, "[ERROR] Failed to open a pooled connection: %s\n", con->get_ec().message().c_str());
+}
+
+/**
+ * @brief 连接池中的连接收到服务器数据时的回调函数
+ * 已交给会话的连接转发给会话，空闲时收到的数据丢弃
+ * @param pooled 连接池中的连接
+ * @param hdl 当前连接的句柄
+ * @param msg 服务器数据
+ */
+void iflytek_wssclient::on_pool_message(pooled_ptr pooled, websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg)
+{
+    session_ptr session;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        session = pooled->session;
+    }
+    if (session)
+    {
+        session->on_message(hdl, msg);
+    }
+}
+
+/**
+ * @brief 连接池中的连接的interrupt回调函数
+ * 转发给使用该连接的会话，在连接的strand上发送下一帧
+ * @param pooled 连接池中的连接
+ * @param hdl 当前连接的句柄
+ */
+void iflytek_wssclient::on_pool_interrupt(pooled_ptr pooled, websocketpp::connection_hdl hdl)
+{
+    session_ptr session;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+        session = pooled->session;
+    }
+    if (session)
+    {
+        this->on_interrupt(session, hdl);
+    }
+}
+
+/**
+ * @brief 为连接设置同一主机上次缓存的tls会话
+ * 在连接发起握手之前调用，服务器接受时进行简化握手，否则自动回退为完整握手
+ * @param con 新创建的连接
+ */
+void iflytek_wssclient::resume_tls_session(asio_tls_client::connection_ptr con)
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(this->lock);
+    std::map<std::string, SSL_SESSION *>::iterator it = this->tls_sessions.find(con->get_host());
+    if (it == this->tls_sessions.end())
+    {
+        return;
+    }
+    if (!SSL_SESSION_is_resumable(it->second))
+    {
+        // 会话已不可复用，丢弃
+        SSL_SESSION_free(it->second);
+        this->tls_sessions.erase(it);
+        return;
+    }
+    SSL_set_session(con->get_socket().native_handle(), it->second);
+}
+
+/**
+ * @brief 获得在ssl上下文中保存客户端指针的扩展数据索引
+ * boost::asio::ssl::context自身占用了app_data，因此另外申请一个索引
+ * @return 扩展数据索引
+ */
+int iflytek_wssclient::tls_ex_index()
+{
+    static int index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+    return index;
+}
+
+/**
+ * @brief 握手得到新的tls会话时的回调函数，按主机缓存该会话
+ * tls1.3的会话票据在握手完成后才由服务器发送，同样经由该回调缓存
+ * @param ssl 当前连接的ssl句柄，通过sni获得主机名
+ * @param tls_session 新的tls会话
+ * @return 返回1表示持有该会话的引用，返回0表示不持有
+ */
+int iflytek_wssclient::on_new_tls_session(SSL *ssl, SSL_SESSION *tls_session)
+{
+    iflytek_wssclient *client = (iflytek_wssclient *)SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), tls_ex_index());
+    const char *host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (client == NULL || host == NULL)
+    {
+        return 0;
+    }
+
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(client->lock);
+    SSL_SESSION *&cached = client->tls_sessions[host];
+    if (cached != NULL)
+    {
+        SSL_SESSION_free(cached);
+    }
+    cached = tls_session;
+    return 1;
+}
+
+/**
+ * @brief 创建所有连接共享的ssl上下文
+ * 开启客户端会话缓存，新会话由on_new_tls_session按主机保存
+ * @return ssl上下文，创建失败时返回空句柄，所有连接将以失败结束
+ */
+context_ptr iflytek_wssclient::build_tls_context()
 {
     context_ptr ctx = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::sslv23);
 
@@ -169,9 +1141,23 @@ context_ptr iflytek_wssclient::on_tls_init()
     catch (std::exception &e)
     {
         fprintf(stderr, "[ERROR] Failed to init tls, %s\n", e.what());
-        exit(1);
+        return context_ptr();
     }
+
+    SSL_CTX *native = ctx->native_handle();
+    SSL_CTX_set_ex_data(native, tls_ex_index(), this);
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(native, &iflytek_wssclient::on_new_tls_session);
     return ctx;
 }
 
-#endif
\ No newline at end of file
+/**
+ * @brief tls初始化，用于wss
+ * @return 共享的ssl上下文，初始化失败时返回空句柄，该连接将以失败结束
+ */
+context_ptr iflytek_wssclient::on_tls_init()
+{
+    return this->tls_context;
+}
+
+#endif
@@ -31,7 +31,19 @@
 namespace websocketpp {
 
 /// Stub for user supplied base class.
-class connection_base {};
+class connection_base {
+public:
+    /// Configure the permessage-deflate extension of a new processor
+    /**
+     * Called by the connection when it creates its processor, before any
+     * handshake is sent or negotiated. User supplied bases may hide this to
+     * apply per connection extension settings. The default does nothing.
+     *
+     * @param ext The extension instance owned by the new processor
+     */
+    template <typename extension>
+    void init_permessage_deflate(extension &) const {}
+};
 
 } // namespace websocketpp
 
@@ -89,6 +89,16 @@ public:
         return false;
     }
 
+    /// Get the minimum payload size to compress
+    /**
+     * The disabled extension never compresses.
+     *
+     * @return Zero
+     */
+    size_t get_min_compress_size() const {
+        return 0;
+    }
+
     /// Generate extension offer
     /**
      * Creates an offer string to include in the Sec-WebSocket-Extensions
@@ -34,6 +34,7 @@
 #include <websocketpp/common/platforms.hpp>
 #include <websocketpp/common/stdint.hpp>
 #include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
 #include <websocketpp/error.hpp>
 
 #include <websocketpp/extensions/extension.hpp>
@@ -41,6 +42,7 @@
 #include "zlib.h"
 
 #include <algorithm>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -214,6 +216,132 @@ enum value {
 };
 } // namespace mode
 
+/// Process wide cache of initialized zlib streams
+/**
+ * Initializing a zlib stream allocates its sliding window and hash tables,
+ * roughly 2^(window_bits+2) + 2^(mem_level+9) bytes for a deflate stream and
+ * 2^window_bits bytes for an inflate stream, and tearing it down frees them
+ * again. Connections that negotiate permessage-deflate can instead return
+ * their streams here when they are destroyed. The streams are reset and keyed
+ * by their parameters, and a later connection with the same parameters takes
+ * one over without touching the allocator.
+ *
+ * The cache holds at most max_idle streams of each direction and is disabled
+ * (max_idle of zero) by default. It is safe to use from multiple threads.
+ */
+class stream_pool {
+public:
+    /// Get the process wide pool
+    static stream_pool & get_instance() {
+        static stream_pool pool;
+        return pool;
+    }
+
+    /// Set the number of idle streams of each direction to keep
+    /**
+     * Lowering the value frees idle streams above the new limit.
+     *
+     * @param max_idle Maximum number of idle streams, zero disables pooling
+     */
+    void set_max_idle(size_t max_idle) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_max_idle = max_idle;
+        trim(m_deflate,true);
+        trim(m_inflate,false);
+    }
+
+    /// Take an idle deflate stream initialized with the given parameters
+    /**
+     * @return A reset stream, or NULL if none is available
+     */
+    z_stream * get_deflate(int level, int window_bits, int mem_level) {
+        return take(m_deflate,key(level,window_bits,mem_level));
+    }
+
+    /// Take an idle inflate stream initialized with the given window size
+    /**
+     * @return A reset stream, or NULL if none is available
+     */
+    z_stream * get_inflate(int window_bits) {
+        return take(m_inflate,key(0,window_bits,0));
+    }
+
+    /// Return a deflate stream, or end it if the pool is full
+    void put_deflate(z_stream * stream, int level, int window_bits,
+        int mem_level)
+    {
+        if (deflateReset(stream) != Z_OK ||
+            !give(m_deflate,key(level,window_bits,mem_level),stream))
+        {
+            deflateEnd(stream);
+            delete stream;
+        }
+    }
+
+    /// Return an inflate stream, or end it if the pool is full
+    void put_inflate(z_stream * stream, int window_bits) {
+        if (inflateReset(stream) != Z_OK ||
+            !give(m_inflate,key(0,window_bits,0),stream))
+        {
+            inflateEnd(stream);
+            delete stream;
+        }
+    }
+
+    ~stream_pool() {
+        m_max_idle = 0;
+        trim(m_deflate,true);
+        trim(m_inflate,false);
+    }
+private:
+    typedef std::vector<std::pair<int,z_stream *> > idle_list;
+
+    stream_pool() : m_max_idle(0) {}
+
+    static int key(int level, int window_bits, int mem_level) {
+        return ((level + 1) << 8) | (window_bits << 4) | mem_level;
+    }
+
+    z_stream * take(idle_list & list, int k) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        for (size_t i = list.size(); i > 0; --i) {
+            if (list[i-1].first == k) {
+                z_stream * stream = list[i-1].second;
+                list.erase(list.begin() + (i-1));
+                return stream;
+            }
+        }
+        return NULL;
+    }
+
+    bool give(idle_list & list, int k, z_stream * stream) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        if (list.size() >= m_max_idle) {
+            return false;
+        }
+        list.push_back(std::make_pair(k,stream));
+        return true;
+    }
+
+    void trim(idle_list & list, bool deflating) {
+        while (list.size() > m_max_idle) {
+            z_stream * stream = list.front().second;
+            if (deflating) {
+                deflateEnd(stream);
+            } else {
+                inflateEnd(stream);
+            }
+            delete stream;
+            list.erase(list.begin());
+        }
+    }
+
+    lib::mutex m_lock;
+    idle_list m_deflate;
+    idle_list m_inflate;
+    size_t m_max_idle;
+};
+
 template <typename config>
 class enabled {
 public:
@@ -226,36 +354,26 @@ public:
       , m_server_max_window_bits_mode(mode::accept)
       , m_client_max_window_bits_mode(mode::accept)
       , m_initialized(false)
+      , m_compression_level(Z_DEFAULT_COMPRESSION)
+      , m_memory_level(4)
+      , m_min_compress_size(0)
+      , m_deflate_bits(0)
+      , m_inflate_bits(0)
       , m_compress_buffer_size(8192)
-    {
-        m_dstate.zalloc = Z_NULL;
-        m_dstate.zfree = Z_NULL;
-        m_dstate.opaque = Z_NULL;
-
-        m_istate.zalloc = Z_NULL;
-        m_istate.zfree = Z_NULL;
-        m_istate.opaque = Z_NULL;
-        m_istate.avail_in = 0;
-        m_istate.next_in = Z_NULL;
-    }
+      , m_dstate(NULL)
+      , m_istate(NULL)
+    {}
 
     ~enabled() {
-        if (!m_initialized) {
-            return;
+        // Streams go back to the pool, which ends them if it is full or
+        // pooling is disabled
+        if (m_dstate) {
+            stream_pool::get_instance().put_deflate(m_dstate,
+                m_compression_level,m_deflate_bits,m_memory_level);
         }
 
-        int ret = deflateEnd(&m_dstate);
-
-        if (ret != Z_OK) {
-            //std::cout << "error cleaning up zlib compression state"
-            //          << std::endl;
-        }
-
-        ret = inflateEnd(&m_istate);
-
-        if (ret != Z_OK) {
-            //std::cout << "error cleaning up zlib decompression state"
-            //          << std::endl;
+        if (m_istate) {
+            stream_pool::get_instance().put_inflate(m_istate,m_inflate_bits);
         }
     }
 
@@ -265,43 +383,68 @@ public:
      * information from the negotiation to determine how to initialize the zlib
      * data structures.
      *
-     * @todo memory level, strategy, etc are hardcoded
+     * Streams are taken from stream_pool when an idle one with the same
+     * parameters is available.
+     *
+     * @todo strategy is hardcoded
      *
      * @param is_server True to initialize as a server, false for a client.
      * @return A code representing the error that occurred, if any
      */
     lib::error_code init(bool is_server) {
-        uint8_t deflate_bits;
-        uint8_t inflate_bits;
-
         if (is_server) {
-            deflate_bits = m_server_max_window_bits;
-            inflate_bits = m_client_max_window_bits;
+            m_deflate_bits = m_server_max_window_bits;
+            m_inflate_bits = m_client_max_window_bits;
         } else {
-            deflate_bits = m_client_max_window_bits;
-            inflate_bits = m_server_max_window_bits;
+            m_deflate_bits = m_client_max_window_bits;
+            m_inflate_bits = m_server_max_window_bits;
         }
 
-        int ret = deflateInit2(
-            &m_dstate,
-            Z_DEFAULT_COMPRESSION,
-            Z_DEFLATED,
-            -1*deflate_bits,
-            4, // memory level 1-9
-            Z_DEFAULT_STRATEGY
-        );
+        stream_pool & pool = stream_pool::get_instance();
+
+        m_dstate = pool.get_deflate(m_compression_level,m_deflate_bits,
+            m_memory_level);
+        if (!m_dstate) {
+            z_stream * stream = new z_stream();
+            stream->zalloc = Z_NULL;
+            stream->zfree = Z_NULL;
+            stream->opaque = Z_NULL;
+
+            int ret = deflateInit2(
+                stream,
+                m_compression_level,
+                Z_DEFLATED,
+                -1*m_deflate_bits,
+                m_memory_level,
+                Z_DEFAULT_STRATEGY
+            );
 
-        if (ret != Z_OK) {
-            return make_error_code(error::zlib_error);
+            if (ret != Z_OK) {
+                delete stream;
+                return make_error_code(error::zlib_error);
+            }
+            m_dstate = stream;
         }
 
-        ret = inflateInit2(
-            &m_istate,
-            -1*inflate_bits
-        );
+        m_istate = pool.get_inflate(m_inflate_bits);
+        if (!m_istate) {
+            z_stream * stream = new z_stream();
+            stream->zalloc = Z_NULL;
+            stream->zfree = Z_NULL;
+            stream->opaque = Z_NULL;
+            stream->avail_in = 0;
+            stream->next_in = Z_NULL;
+
+            int ret = inflateInit2(
+                stream,
+                -1*m_inflate_bits
+            );
 
-        if (ret != Z_OK) {
-            return make_error_code(error::zlib_error);
+            if (ret != Z_OK) {
+                delete stream;
+                return make_error_code(error::zlib_error);
+            }
+            m_istate = stream;
         }
 
         m_compress_buffer.reset(new unsigned char[m_compress_buffer_size]);
@@ -473,16 +616,94 @@ public:
         return lib::error_code();
     }
 
+    /// Set the zlib compression level for outgoing messages
+    /**
+     * Must be called before the extension is initialized. Lower levels trade
+     * compression ratio for CPU time. The default is Z_DEFAULT_COMPRESSION.
+     *
+     * @param level The zlib compression level, -1 (default) or 0 to 9
+     * @return A status code
+     */
+    lib::error_code set_compression_level(int level) {
+        if (level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION) {
+            return make_error_code(error::invalid_attribute_value);
+        }
+        m_compression_level = level;
+        return lib::error_code();
+    }
+
+    /// Set the zlib memory level for outgoing messages
+    /**
+     * Must be called before the extension is initialized. The compressor's
+     * hash table takes 2^(level+9) bytes. The default is 4.
+     *
+     * @param level The zlib memory level, 1 to 9
+     * @return A status code
+     */
+    lib::error_code set_memory_level(int level) {
+        if (level < 1 || level > MAX_MEM_LEVEL) {
+            return make_error_code(error::invalid_attribute_value);
+        }
+        m_memory_level = level;
+        return lib::error_code();
+    }
+
+    /// Send messages smaller than the given size uncompressed
+    /**
+     * The deflate block header and flush marker cost several bytes, so very
+     * small messages are often larger compressed. Messages below this size
+     * are sent without the RSV1 bit and do not touch the compression context.
+     *
+     * @param size The minimum payload size to compress, zero compresses all
+     */
+    void set_min_compress_size(size_t size) {
+        m_min_compress_size = size;
+    }
+
+    /// Get the minimum payload size to compress
+    /**
+     * @return The minimum payload size to compress
+     */
+    size_t get_min_compress_size() const {
+        return m_min_compress_size;
+    }
+
     /// Generate extension offer
     /**
      * Creates an offer string to include in the Sec-WebSocket-Extensions
-     * header of outgoing client requests.
+     * header of outgoing client requests from the current settings. Context
+     * takeover options are offered when enabled, window sizes when they are
+     * below the default. client_max_window_bits is always offered so the
+     * server may limit the client's window.
      *
      * @return A WebSocket extension offer string for this extension
      */
     std::string generate_offer() const {
-        // TODO: this should be dynamically generated based on user settings
-        return "permessage-deflate; client_no_context_takeover; client_max_window_bits";
+        std::string ret = "permessage-deflate";
+
+        if (m_server_no_context_takeover) {
+            ret += "; server_no_context_takeover";
+        }
+
+        if (m_client_no_context_takeover) {
+            ret += "; client_no_context_takeover";
+        }
+
+        if (m_server_max_window_bits < default_server_max_window_bits) {
+            std::stringstream s;
+            s << int(m_server_max_window_bits);
+            ret += "; server_max_window_bits="+s.str();
+        }
+
+        if (m_client_max_window_bits < default_client_max_window_bits) {
+            std::stringstream s;
+            s << int(m_client_max_window_bits);
+            ret += "; client_max_window_bits="+s.str();
+        } else {
+            ret += "; client_max_window_bits";
+        }
+
+        return ret;
     }
 
     /// Validate extension response
@@ -558,20 +779,20 @@ public:
             return lib::error_code();
         }
 
-        m_dstate.avail_in = in.size();
-        m_dstate.next_in = (unsigned char *)(const_cast<char *>(in.data()));
+        m_dstate->avail_in = in.size();
+        m_dstate->next_in = (unsigned char *)(const_cast<char *>(in.data()));
 
         do {
             // Output to local buffer
-            m_dstate.avail_out = m_compress_buffer_size;
-            m_dstate.next_out = m_compress_buffer.get();
+            m_dstate->avail_out = m_compress_buffer_size;
+            m_dstate->next_out = m_compress_buffer.get();
 
-            deflate(&m_dstate, m_flush);
+            deflate(m_dstate, m_flush);
 
-            output = m_compress_buffer_size - m_dstate.avail_out;
+            output = m_compress_buffer_size - m_dstate->avail_out;
 
             out.append((char *)(m_compress_buffer.get()),output);
-        } while (m_dstate.avail_out == 0);
+        } while (m_dstate->avail_out == 0);
 
         return lib::error_code();
     }
@@ -592,14 +813,14 @@ public:
 
         int ret;
 
-        m_istate.avail_in = len;
-        m_istate.next_in = const_cast<unsigned char *>(buf);
+        m_istate->avail_in = len;
+        m_istate->next_in = const_cast<unsigned char *>(buf);
 
         do {
-            m_istate.avail_out = m_compress_buffer_size;
-            m_istate.next_out = m_decompress_buffer.get();
+            m_istate->avail_out = m_compress_buffer_size;
+            m_istate->next_out = m_decompress_buffer.get();
 
-            ret = inflate(&m_istate, Z_SYNC_FLUSH);
+            ret = inflate(m_istate, Z_SYNC_FLUSH);
 
             if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR) {
                 return make_error_code(error::zlib_error);
@@ -607,9 +828,9 @@ public:
 
             out.append(
                 reinterpret_cast<char *>(m_decompress_buffer.get()),
-                m_compress_buffer_size - m_istate.avail_out
+                m_compress_buffer_size - m_istate->avail_out
             );
-        } while (m_istate.avail_out == 0);
+        } while (m_istate->avail_out == 0);
 
         return lib::error_code();
     }
@@ -803,11 +1024,16 @@ private:
 
     bool m_initialized;
     int m_flush;
+    int m_compression_level;
+    int m_memory_level;
+    size_t m_min_compress_size;
+    uint8_t m_deflate_bits;
+    uint8_t m_inflate_bits;
     size_t m_compress_buffer_size;
     lib::unique_ptr_uchar_array m_compress_buffer;
     lib::unique_ptr_uchar_array m_decompress_buffer;
-    z_stream m_dstate;
-    z_stream m_istate;
+    z_stream * m_dstate;
+    z_stream * m_istate;
 };
 
 } // namespace permessage_deflate
@@ -36,6 +36,15 @@
 
 #include <websocketpp/utilities.hpp>
 
+// SIMD masking kernels are compiled in on GCC/Clang x86 targets and selected
+// at runtime based on the CPU. Define _WEBSOCKETPP_NO_SIMD_MASKING_ to always
+// use the portable byte by byte implementation.
+#if !defined(_WEBSOCKETPP_NO_SIMD_MASKING_) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define _WEBSOCKETPP_SIMD_MASKING_
+#endif
+
 namespace websocketpp {
 /// Data structures and utility functions for manipulating WebSocket frames
 /**
@@ -312,6 +321,9 @@ void word_mask_exact(uint8_t * data, size_t length, masking_key_type const &
 size_t word_mask_circ(uint8_t * input, uint8_t * output, size_t length,
     size_t prepared_key);
 size_t word_mask_circ(uint8_t * data, size_t length, size_t prepared_key);
+size_t simd_mask_circ(uint8_t const * input, uint8_t * output, size_t length,
+    size_t prepared_key);
+size_t simd_mask_circ(uint8_t * data, size_t length, size_t prepared_key);
 
 /// Check whether the frame's FIN bit is set.
 /**
@@ -858,6 +870,139 @@ inline size_t byte_mask_circ(uint8_t* data, size_t length, size_t prepared_key){
     return byte_mask_circ(data,data,length,prepared_key);
 }
 
+#ifdef _WEBSOCKETPP_SIMD_MASKING_
+/// SSE2 mask/unmask kernel
+/**
+ * Masks 32 bytes per iteration with unaligned loads and stores. Every block
+ * is a multiple of 4 bytes so the broadcast key stays in phase. The remaining
+ * bytes are left for the caller.
+ *
+ * @return Number of bytes masked
+ */
+__attribute__((target("sse2")))
+inline size_t simd_mask_sse2(uint8_t const * input, uint8_t * output,
+    size_t length, uint32_t key)
+{
+    __m128i k = _mm_set1_epi32(static_cast<int>(key));
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input+i));
+        __m128i b = _mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(input+i+16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output+i),
+            _mm_xor_si128(a,k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output+i+16),
+            _mm_xor_si128(b,k));
+    }
+    return i;
+}
+
+/// AVX2 mask/unmask kernel
+/**
+ * Masks 64 bytes per iteration, then hands the remainder of at least 32 bytes
+ * to the SSE2 kernel. The remaining bytes are left for the caller.
+ *
+ * @return Number of bytes masked
+ */
+__attribute__((target("avx2")))
+inline size_t simd_mask_avx2(uint8_t const * input, uint8_t * output,
+    size_t length, uint32_t key)
+{
+    __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m256i a = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const *>(input+i));
+        __m256i b = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const *>(input+i+32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output+i),
+            _mm256_xor_si256(a,k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output+i+32),
+            _mm256_xor_si256(b,k));
+    }
+    // avoid AVX-SSE transition penalties in the SSE2 kernel and caller
+    _mm256_zeroupper();
+    return i + simd_mask_sse2(input+i,output+i,length-i,key);
+}
+
+/// Detect the widest masking kernel supported by the running CPU
+/**
+ * @return 2 for AVX2, 1 for SSE2, 0 for the byte by byte fallback
+ */
+inline int simd_mask_level() {
+    static int const level = __builtin_cpu_supports("avx2") ? 2 :
+        (__builtin_cpu_supports("sse2") ? 1 : 0);
+    return level;
+}
+#endif // _WEBSOCKETPP_SIMD_MASKING_
+
+/// Circular SIMD mask/unmask
+/**
+ * Drop-in replacement for byte_mask_circ that masks with the widest SIMD
+ * kernel supported by the running CPU (AVX2, then SSE2) and finishes the
+ * remaining bytes one at a time. Output is bit-exact with byte_mask_circ for
+ * any length, key offset and alignment, and there are no requirements on the
+ * size of the underlying buffers. input and output may be the same buffer.
+ *
+ * Falls back to byte_mask_circ where SIMD masking is not compiled in.
+ *
+ * @param input Character buffer to mask
+ *
+ * @param output Buffer to store the output. May be the same as input.
+ *
+ * @param length Length of data
+ *
+ * @param prepared_key Prepared key to use.
+ *
+ * @return the prepared_key shifted to account for the input length
+ */
+inline size_t simd_mask_circ(uint8_t const * input, uint8_t * output,
+    size_t length, size_t prepared_key)
+{
+#ifdef _WEBSOCKETPP_SIMD_MASKING_
+    uint32_converter key;
+    key.i = static_cast<uint32_t>(prepared_key);
+
+    size_t i = 0;
+    switch (simd_mask_level()) {
+        case 2:
+            i = simd_mask_avx2(input,output,length,key.i);
+            break;
+        case 1:
+            i = simd_mask_sse2(input,output,length,key.i);
+            break;
+    }
+
+    // i is a multiple of 4, so the tail starts at key byte 0
+    for (; i < length; ++i) {
+        output[i] = input[i] ^ key.c[i % 4];
+    }
+
+    return circshift_prepared_key(prepared_key,length % 4);
+#else
+    return byte_mask_circ(const_cast<uint8_t *>(input),output,length,
+        prepared_key);
+#endif
+}
+
+/// Circular SIMD mask/unmask (in place)
+/**
+ * In place version of simd_mask_circ
+ *
+ * @see simd_mask_circ
+ *
+ * @param data Character buffer to read from and write to
+ *
+ * @param length Length of data
+ *
+ * @param prepared_key Prepared key to use.
+ *
+ * @return the prepared_key shifted to account for the input length
+ */
+inline size_t simd_mask_circ(uint8_t* data, size_t length, size_t prepared_key){
+    return simd_mask_circ(data,data,length,prepared_key);
+}
+
 } // namespace frame
 } // namespace websocketpp
 
@@ -2173,29 +2173,44 @@ connection<config>::get_processor(int version) const {
             );
             break;
         case 7:
-            p = lib::make_shared<processor::hybi07<config> >(
-                transport_con_type::is_secure(),
-                m_is_server,
-                m_msg_manager,
-                lib::ref(m_rng)
-            );
+        {
+            lib::shared_ptr<processor::hybi07<config> > hybi =
+                lib::make_shared<processor::hybi07<config> >(
+                    transport_con_type::is_secure(),
+                    m_is_server,
+                    m_msg_manager,
+                    lib::ref(m_rng)
+                );
+            this->init_permessage_deflate(hybi->get_permessage_deflate());
+            p = hybi;
             break;
+        }
         case 8:
-            p = lib::make_shared<processor::hybi08<config> >(
-                transport_con_type::is_secure(),
-                m_is_server,
-                m_msg_manager,
-                lib::ref(m_rng)
-            );
+        {
+            lib::shared_ptr<processor::hybi08<config> > hybi =
+                lib::make_shared<processor::hybi08<config> >(
+                    transport_con_type::is_secure(),
+                    m_is_server,
+                    m_msg_manager,
+                    lib::ref(m_rng)
+                );
+            this->init_permessage_deflate(hybi->get_permessage_deflate());
+            p = hybi;
             break;
+        }
         case 13:
-            p = lib::make_shared<processor::hybi13<config> >(
-                transport_con_type::is_secure(),
-                m_is_server,
-                m_msg_manager,
-                lib::ref(m_rng)
-            );
+        {
+            lib::shared_ptr<processor::hybi13<config> > hybi =
+                lib::make_shared<processor::hybi13<config> >(
+                    transport_con_type::is_secure(),
+                    m_is_server,
+                    m_msg_manager,
+                    lib::ref(m_rng)
+                );
+            this->init_permessage_deflate(hybi->get_permessage_deflate());
+            p = hybi;
             break;
+        }
         default:
             return p;
     }
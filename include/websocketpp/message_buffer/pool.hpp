@@ -25,54 +25,21 @@
  *
  */
 
-#ifndef WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
-#define WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
+#ifndef WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
+#define WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
 
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/frame.hpp>
 
+#include <cstddef>
+#include <new>
 #include <string>
+#include <vector>
 
 namespace websocketpp {
 namespace message_buffer {
 
-/* # message:
- * object that stores a message while it is being sent or received. Contains
- * the message payload itself, the message header, the extension data, and the
- * opcode.
- *
- * # connection_message_manager:
- * An object that manages all of the message_buffers associated with a given
- * connection. Implements the get_message_buffer(size) method that returns
- * a message buffer at least size bytes long.
- *
- * Message buffers are reference counted with shared ownership semantics. Once
- * requested from the manager the requester and it's associated downstream code
- * may keep a pointer to the message indefinitely at a cost of extra resource
- * usage. Once the reference count drops to the point where the manager is the
- * only reference the messages is recycled using whatever method is implemented
- * in the manager.
- *
- * # endpoint_message_manager:
- * An object that manages connection_message_managers. Implements the
- * get_message_manager() method. This is used once by each connection to
- * request the message manager that they are supposed to use to manage message
- * buffers for their own use.
- *
- * TYPES OF CONNECTION_MESSAGE_MANAGERS
- * - allocate a message with the exact size every time one is requested
- * - maintain a pool of pre-allocated messages and return one when needed.
- *   Recycle previously used messages back into the pool
- *
- * TYPES OF ENDPOINT_MESSAGE_MANAGERS
- *  - allocate a new connection manager for each connection. Message pools
- *    become connection specific. This increases memory usage but improves
- *    concurrency.
- *  - allocate a single connection manager and share a pointer to it with all
- *    connections created by this endpoint. The message pool will be shared
- *    among all connections, improving memory usage and performance at the cost
- *    of reduced concurrency
- */
-
 /// Custom deleter for use in shared_ptrs to message.
 /**
  * This is used to catch messages about to be deleted and offer the manager the
@@ -92,105 +59,293 @@ void message_deleter(T* msg) {
     }
 }
 
-/// Represents a buffer for a single WebSocket message.
+namespace pool {
+
+/// A cache of equally sized memory blocks
 /**
+ * Backs the shared_ptr control blocks of pooled messages. Every pooled message
+ * handed out needs a fresh control block, and all of them have the same size,
+ * so freed blocks are kept and handed out again instead of going back to the
+ * allocator. The cache adopts the size of the first block returned to it and
+ * keeps at most max_blocks blocks; other requests go to operator new.
  *
- *
+ * The cache is shared by the connection message manager and every control
+ * block allocated from it, so it stays alive until the last message that used
+ * it is gone, even if the connection is destroyed first.
  */
-template <typename con_msg_manager>
-class message {
+class block_cache {
+public:
+    typedef lib::shared_ptr<block_cache> ptr;
+
+    explicit block_cache(size_t max_blocks)
+      : m_block_size(0)
+      , m_max_blocks(max_blocks)
+    {
+        m_blocks.reserve(max_blocks);
+    }
+
+    ~block_cache() {
+        for (size_t i = 0; i < m_blocks.size(); ++i) {
+            ::operator delete(m_blocks[i]);
+        }
+    }
+
+    /// Get a block of at least size bytes
+    void * allocate(size_t size) {
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (size == m_block_size && !m_blocks.empty()) {
+                void * block = m_blocks.back();
+                m_blocks.pop_back();
+                return block;
+            }
+        }
+        return ::operator new(size);
+    }
+
+    /// Return a block of size bytes obtained from allocate
+    void deallocate(void * block, size_t size) {
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (m_block_size == 0) {
+                m_block_size = size;
+            }
+            if (size == m_block_size && m_blocks.size() < m_max_blocks) {
+                m_blocks.push_back(block);
+                return;
+            }
+        }
+        ::operator delete(block);
+    }
+private:
+    lib::mutex m_lock;
+    std::vector<void *> m_blocks;
+    size_t m_block_size;
+    size_t m_max_blocks;
+};
+
+/// Allocator that draws from a block_cache
+/**
+ * Used for the control blocks of shared_ptrs to pooled messages.
+ */
+template <typename T>
+class block_allocator {
 public:
-    typedef lib::shared_ptr<message> ptr;
+    typedef T value_type;
+    typedef T * pointer;
+    typedef T const * const_pointer;
+    typedef T & reference;
+    typedef T const & const_reference;
+    typedef size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef block_allocator<U> other;
+    };
 
-    typedef typename con_msg_manager::weak_ptr con_msg_man_ptr;
+    explicit block_allocator(block_cache::ptr cache) : m_cache(cache) {}
 
-    message(con_msg_man_ptr manager, size_t size = 128)
-      : m_manager(manager)
-      , m_payload(size) {}
+    template <typename U>
+    block_allocator(block_allocator<U> const & other)
+      : m_cache(other.get_cache()) {}
 
-    frame::opcode::value get_opcode() const {
-        return m_opcode;
+    pointer allocate(size_type n, void const * = 0) {
+        return static_cast<pointer>(m_cache->allocate(n * sizeof(T)));
     }
-    const std::string& get_header() const {
-        return m_header;
+
+    void deallocate(pointer p, size_type n) {
+        m_cache->deallocate(p, n * sizeof(T));
     }
-    const std::string& get_extension_data() const {
-        return m_extension_data;
+
+    size_type max_size() const {
+        return size_type(-1) / sizeof(T);
     }
-    const std::string& get_payload() const {
-        return m_payload;
+
+    void construct(pointer p, const_reference value) {
+        new (static_cast<void *>(p)) T(value);
     }
 
-    /// Recycle the message
-    /**
-     * A request to recycle this message was received. Forward that request to
-     * the connection message manager for processing. Errors and exceptions
-     * from the manager's recycle member function should be passed back up the
-     * call chain. The caller to message::recycle will deal with them.
-     *
-     * Recycle must *only* be called by the message shared_ptr's destructor.
-     * Once recycled successfully, ownership of the memory has been passed to
-     * another system and must not be accessed again.
-     *
-     * @return true if the message was successfully recycled, false otherwise.
-     */
-    bool recycle() {
-        typename con_msg_manager::ptr shared = m_manager.lock();
+    void destroy(pointer p) {
+        p->~T();
+    }
 
-        if (shared) {
-            return shared->(recycle(this));
-        } else {
-            return false;
-        }
+    block_cache::ptr const & get_cache() const {
+        return m_cache;
     }
 private:
-    con_msg_man_ptr             m_manager;
-
-    frame::opcode::value        m_opcode;
-    std::string                 m_header;
-    std::string                 m_extension_data;
-    std::string                 m_payload;
+    block_cache::ptr m_cache;
 };
 
-namespace alloc {
+template <typename T, typename U>
+bool operator==(block_allocator<T> const & a, block_allocator<U> const & b) {
+    return a.get_cache() == b.get_cache();
+}
+
+template <typename T, typename U>
+bool operator!=(block_allocator<T> const & a, block_allocator<U> const & b) {
+    return a.get_cache() != b.get_cache();
+}
 
-/// A connection message manager that allocates a new message for each
-/// request.
+/// A connection messages manager that maintains a pool of messages that is
+/// used to fulfill get_message requests.
+/**
+ * Messages handed out by this manager are owned through message_deleter.
+ * When the last reference to one is released it is reset and returned to the
+ * pool instead of being freed, keeping the capacity of its payload, and the
+ * next get_message call hands it out again. The shared_ptr control blocks come
+ * from a block_cache, so once a connection has sent and received a few
+ * messages of its usual size, getting a message no longer touches the heap.
+ *
+ * At most max_messages messages are pooled. If all of them are in use further
+ * messages are allocated individually and freed when released. A pooled
+ * message whose payload capacity grew beyond max_payload is freed when it is
+ * released so that a single large message does not pin its buffer for the
+ * life of the connection.
+ *
+ * Messages may be released from any thread. Messages that outlive their
+ * manager are freed normally.
+ */
 template <typename message>
-class con_msg_manager {
+class con_msg_manager
+  : public lib::enable_shared_from_this<con_msg_manager<message> >
+{
 public:
+    typedef con_msg_manager<message> type;
     typedef lib::shared_ptr<con_msg_manager> ptr;
     typedef lib::weak_ptr<con_msg_manager> weak_ptr;
 
     typedef typename message::ptr message_ptr;
 
-    /// Get a message buffer with specified size
+    /// The default maximum number of pooled messages per connection
+    static size_t const default_max_messages = 16;
+
+    /// The default maximum payload capacity kept by a pooled message
+    static size_t const default_max_payload = 32768;
+
+    /// Construct a message manager
+    /**
+     * @param max_messages Maximum number of pooled messages
+     * @param max_payload Maximum payload capacity kept by a pooled message
+     */
+    explicit con_msg_manager(size_t max_messages = default_max_messages,
+        size_t max_payload = default_max_payload)
+      : m_blocks(lib::make_shared<block_cache>(max_messages))
+      , m_pooled(0)
+      , m_max_messages(max_messages)
+      , m_max_payload(max_payload)
+    {
+        m_idle.reserve(max_messages);
+    }
+
+    ~con_msg_manager() {
+        for (size_t i = 0; i < m_idle.size(); ++i) {
+            delete m_idle[i];
+        }
+    }
+
+    /// Get an empty message buffer
+    /**
+     * @return A shared pointer to an empty message
+     */
+    message_ptr get_message() {
+        message * msg = take();
+
+        if (!msg) {
+            return message_ptr(lib::make_shared<message>(
+                type::shared_from_this()));
+        }
+
+        return message_ptr(msg,&message_deleter<message>,
+            block_allocator<message>(m_blocks));
+    }
+
+    /// Get a message buffer with specified size and opcode
     /**
+     * @param op The opcode to use
      * @param size Minimum size in bytes to request for the message payload.
      *
-     * @return A shared pointer to a new message with specified size.
+     * @return A shared pointer to an empty message with specified size.
      */
-    message_ptr get_message(size_t size) const {
-        return lib::make_shared<message>(size);
+    message_ptr get_message(frame::opcode::value op,size_t size) {
+        message * msg = take();
+
+        if (!msg) {
+            return message_ptr(lib::make_shared<message>(
+                type::shared_from_this(),op,size));
+        }
+
+        msg->set_opcode(op);
+        msg->get_raw_payload().reserve(size);
+
+        return message_ptr(msg,&message_deleter<message>,
+            block_allocator<message>(m_blocks));
     }
 
     /// Recycle a message
     /**
-     * This method shouldn't be called. If it is, return false to indicate an
-     * error. The rest of the method recycle chain should notice this and free
-     * the memory.
+     * Called by message_deleter through message::recycle when the last
+     * reference to a pooled message is released. Resets the message and puts
+     * it back into the pool.
      *
      * @param msg The message to be recycled.
      *
-     * @return true if the message was successfully recycled, false otherwse.
+     * @return true if the message was recycled, false if it should be freed.
      */
     bool recycle(message * msg) {
-        return false;
+        if (msg->get_raw_payload().capacity() > m_max_payload) {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            --m_pooled;
+            return false;
+        }
+
+        msg->set_prepared(false);
+        msg->set_fin(true);
+        msg->set_terminal(false);
+        msg->set_compressed(false);
+        msg->set_header(std::string());
+        msg->get_raw_payload().clear();
+
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_idle.push_back(msg);
+        return true;
+    }
+private:
+    /// Take an idle pooled message, or create one if the pool has room
+    /**
+     * @return A pooled message, or NULL if all pooled messages are in use
+     */
+    message * take() {
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (!m_idle.empty()) {
+                message * msg = m_idle.back();
+                m_idle.pop_back();
+                return msg;
+            }
+            if (m_pooled >= m_max_messages) {
+                return NULL;
+            }
+            ++m_pooled;
+        }
+
+        return new message(type::shared_from_this());
     }
+
+    lib::mutex m_lock;
+    std::vector<message *> m_idle;
+    block_cache::ptr m_blocks;
+    size_t m_pooled;
+    size_t m_max_messages;
+    size_t m_max_payload;
 };
 
-/// An endpoint message manager that allocates a new manager for each
+/// An endpoint message manager that allocates a new pooled manager for each
 /// connection.
+/**
+ * Each connection gets its own pool, so connections do not contend for the
+ * pool lock.
+ */
 template <typename con_msg_manager>
 class endpoint_msg_manager {
 public:
@@ -201,29 +356,12 @@ public:
      * @return A pointer to the requested connection message manager.
      */
     con_msg_man_ptr get_manager() const {
-        return lib::make_shared<con_msg_manager>();
+        return con_msg_man_ptr(lib::make_shared<con_msg_manager>());
     }
 };
 
-} // namespace alloc
-
-namespace pool {
-
-/// A connection messages manager that maintains a pool of messages that is
-/// used to fulfill get_message requests.
-class con_msg_manager {
-
-};
-
-/// An endpoint manager that maintains a shared pool of connection managers
-/// and returns an appropriate one for the requesting connection.
-class endpoint_msg_manager {
-
-};
-
 } // namespace pool
-
 } // namespace message_buffer
 } // namespace websocketpp
 
-#endif // WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
+#endif // WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
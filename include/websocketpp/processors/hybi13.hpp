@@ -85,6 +85,11 @@ public:
         return m_permessage_deflate.is_implemented();
     }
 
+    /// Get the permessage-deflate extension instance of this processor
+    permessage_deflate_type & get_permessage_deflate() {
+        return m_permessage_deflate;
+    }
+
     err_str_pair negotiate_extensions(request_type const & request) {
         return negotiate_extensions_helper(request);
     }
@@ -626,7 +631,9 @@ public:
         frame::masking_key_type key;
         bool masked = !base::m_server;
         bool compressed = m_permessage_deflate.is_enabled()
-                          && in->get_compressed();
+                          && in->get_compressed()
+                          && i.size() >=
+                             m_permessage_deflate.get_min_compress_size();
         bool fin = in->get_fin();
 
         if (masked) {
@@ -800,9 +807,8 @@ protected:
     {
         // unmask if masked
         if (frame::get_masked(m_basic_header)) {
-            m_current_msg->prepared_key = frame::byte_mask_circ(
+            m_current_msg->prepared_key = frame::simd_mask_circ(
                 buf, len, m_current_msg->prepared_key);
-            // TODO: SIMD masking
         }
 
         std::string & out = m_current_msg->msg_ptr->get_raw_payload();
@@ -824,7 +830,9 @@ protected:
 
         // validate unmasked, decompressed values
         if (m_current_msg->msg_ptr->get_opcode() == frame::opcode::TEXT) {
-            if (!m_current_msg->validator.decode(out.begin()+offset,out.end())) {
+            if (!m_current_msg->validator.decode(out.data()+offset,
+                out.data()+out.size()))
+            {
                 ec = make_error_code(error::invalid_utf8);
                 return 0;
             }
@@ -953,6 +961,8 @@ protected:
     /// Copy and mask/unmask in one operation
     /**
      * Reads input from one string and writes unmasked output to another.
+     * o must already be at least as long as i and may be the same string.
+     * Uses the SIMD kernels selected by frame::simd_mask_circ.
      *
      * @param [in] i The input string.
      * @param [out] o The output string.
@@ -961,8 +971,12 @@ protected:
     void masked_copy (std::string const & i, std::string & o,
         frame::masking_key_type key) const
     {
-        frame::byte_mask(i.begin(),i.end(),o.begin(),key);
-        // TODO: SIMD masking
+        if (i.empty()) {
+            return;
+        }
+        frame::simd_mask_circ(reinterpret_cast<uint8_t const *>(i.data()),
+            reinterpret_cast<uint8_t *>(&o[0]),i.size(),
+            frame::prepare_masking_key(key));
     }
 
     /// Generic prepare control frame with opcode and payload.
@@ -46,6 +46,7 @@
 #include <websocketpp/common/functional.hpp>
 #include <websocketpp/common/connection_hdl.hpp>
 
+#include <algorithm>
 #include <istream>
 #include <sstream>
 #include <string>
@@ -936,11 +937,19 @@ protected:
     }
 
     /// Initiate a potentially asyncronous write of the given buffers
+    /**
+     * On secure connections small buffers are first gathered into a staging
+     * buffer, see stage_tls_write.
+     */
     void async_write(std::vector<buffer> const & bufs, write_handler handler) {
-        std::vector<buffer>::const_iterator it;
+        if (socket_con_type::is_secure()) {
+            stage_tls_write(bufs);
+        } else {
+            std::vector<buffer>::const_iterator it;
 
-        for (it = bufs.begin(); it != bufs.end(); ++it) {
-            m_bufs.push_back(lib::asio::buffer((*it).buf,(*it).len));
+            for (it = bufs.begin(); it != bufs.end(); ++it) {
+                m_bufs.push_back(lib::asio::buffer((*it).buf,(*it).len));
+            }
         }
 
         if (config::enable_multithreading) {
@@ -972,6 +981,55 @@ protected:
         }
     }
 
+    /// Gather small buffers of a TLS write into one contiguous buffer
+    /**
+     * asio::ssl::stream passes a buffer sequence to the TLS engine one buffer
+     * at a time (newer asio versions linearise up to 8 KiB first) and each
+     * pass produces at least one TLS record, with its own MAC and socket
+     * write. Without gathering, the 2-14 byte header of every frame would
+     * become a record of its own.
+     *
+     * Buffers that fit into the remaining space of a staging buffer of one
+     * full TLS record (16 KiB of plaintext) are copied there, so the headers
+     * and payloads of small frames are encrypted together. Buffers that do
+     * not fit are passed through untouched. Later small buffers continue in
+     * the remaining staging space, so at most 16 KiB is copied per write.
+     *
+     * The staging buffer is allocated on the first secure write and is
+     * reused until the connection is destroyed. It is not touched again
+     * until handle_async_write has run.
+     *
+     * @param bufs The buffers of the write
+     */
+    void stage_tls_write(std::vector<buffer> const & bufs) {
+        if (!m_write_staging) {
+            m_write_staging.reset(new unsigned char[write_staging_size]);
+        }
+
+        unsigned char * staging = m_write_staging.get();
+        size_t start = 0;
+        size_t used = 0;
+
+        std::vector<buffer>::const_iterator it;
+        for (it = bufs.begin(); it != bufs.end(); ++it) {
+            if ((*it).len <= write_staging_size - used) {
+                std::copy((*it).buf,(*it).buf+(*it).len,staging+used);
+                used += (*it).len;
+                continue;
+            }
+
+            if (used > start) {
+                m_bufs.push_back(lib::asio::buffer(staging+start,used-start));
+                start = used;
+            }
+            m_bufs.push_back(lib::asio::buffer((*it).buf,(*it).len));
+        }
+
+        if (used > start) {
+            m_bufs.push_back(lib::asio::buffer(staging+start,used-start));
+        }
+    }
+
     /// Async write callback
     /**
      * @param ec The status code
@@ -1178,6 +1236,13 @@ private:
 
     std::vector<lib::asio::const_buffer> m_bufs;
 
+    /// Size of the staging buffer for TLS writes, the maximum TLS record
+    /// plaintext
+    static size_t const write_staging_size = 16384;
+
+    /// Staging buffer that small buffers of a TLS write are gathered into
+    lib::unique_ptr_uchar_array m_write_staging;
+
     /// Detailed internal error code
     lib::asio::error_code m_tec;
 
@@ -31,8 +31,19 @@
 
 #include <websocketpp/common/stdint.hpp>
 
+#include <algorithm>
+#include <cstddef>
 #include <string>
 
+// SIMD validation kernels are compiled in on GCC/Clang x86 targets and
+// selected at runtime based on the CPU. Define _WEBSOCKETPP_NO_SIMD_UTF8_ to
+// always use the byte at a time state machine.
+#if !defined(_WEBSOCKETPP_NO_SIMD_UTF8_) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define _WEBSOCKETPP_SIMD_UTF8_
+#endif
+
 namespace websocketpp {
 namespace utf8_validator {
 
@@ -77,6 +88,220 @@ inline uint32_t decode(uint32_t * state, uint32_t * codep, uint8_t byte) {
   return *state;
 }
 
+#ifdef _WEBSOCKETPP_SIMD_UTF8_
+namespace simd {
+
+// Error classes of the lookup algorithm from Keiser & Lemire, "Validating
+// UTF-8 In Less Than One Instruction Per Byte". Each class is a bit that is
+// set in all three lookup tables only for the byte pairs it describes.
+static uint8_t const TOO_SHORT = 1<<0;      // 11______ 0_______ or 11______
+static uint8_t const TOO_LONG = 1<<1;       // 0_______ 10______
+static uint8_t const OVERLONG_3 = 1<<2;     // 11100000 100_____
+static uint8_t const TOO_LARGE = 1<<3;      // 11110100 1001____ and above
+static uint8_t const SURROGATE = 1<<4;      // 11101101 101_____
+static uint8_t const OVERLONG_2 = 1<<5;     // 1100000_ 10______
+static uint8_t const TOO_LARGE_1000 = 1<<6; // 11110101 1000____ and above
+static uint8_t const OVERLONG_4 = 1<<6;     // 11110000 1000____
+static uint8_t const TWO_CONTS = 1<<7;      // 10______ 10______
+static uint8_t const CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+/// Classify each byte pair by the high nibble of the first byte
+static uint8_t const byte_1_high[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+/// Classify each byte pair by the low nibble of the first byte
+static uint8_t const byte_1_low[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+/// Classify each byte pair by the high nibble of the second byte
+static uint8_t const byte_2_high[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+/// Find the errors in one 16 byte block given the preceding block (SSSE3)
+__attribute__((target("ssse3")))
+inline __m128i check_block_ssse3(__m128i input, __m128i prev_input) {
+    __m128i const low_nibble = _mm_set1_epi8(0x0F);
+    __m128i const t1h = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(byte_1_high));
+    __m128i const t1l = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(byte_1_low));
+    __m128i const t2h = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(byte_2_high));
+
+    __m128i prev1 = _mm_alignr_epi8(input,prev_input,15);
+    __m128i special = _mm_and_si128(_mm_and_si128(
+        _mm_shuffle_epi8(t1h,_mm_and_si128(_mm_srli_epi16(prev1,4),low_nibble)),
+        _mm_shuffle_epi8(t1l,_mm_and_si128(prev1,low_nibble))),
+        _mm_shuffle_epi8(t2h,_mm_and_si128(_mm_srli_epi16(input,4),low_nibble)));
+
+    // the third and fourth bytes of 3 and 4 byte sequences must be
+    // continuations, which is exactly where TWO_CONTS is expected
+    __m128i prev2 = _mm_alignr_epi8(input,prev_input,14);
+    __m128i prev3 = _mm_alignr_epi8(input,prev_input,13);
+    __m128i must23 = _mm_or_si128(
+        _mm_subs_epu8(prev2,_mm_set1_epi8(static_cast<char>(0xE0-0x80))),
+        _mm_subs_epu8(prev3,_mm_set1_epi8(static_cast<char>(0xF0-0x80))));
+    __m128i must23_80 = _mm_and_si128(must23,
+        _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(must23_80,special);
+}
+
+/// Validate a buffer 16 bytes at a time (SSSE3)
+/**
+ * Blocks of ASCII that follow an ASCII block are skipped with a single
+ * movemask. The partial block at the end is zero padded, and an implicit
+ * ASCII block after it reports any sequence left open as too short.
+ *
+ * @param data Start of the input. Must not start inside a multibyte sequence.
+ * @param length Length of the input
+ * @return Whether every sequence in the input is valid and complete
+ */
+__attribute__((target("ssse3")))
+inline bool validate_ssse3(uint8_t const * data, size_t length) {
+    __m128i error = _mm_setzero_si128();
+    __m128i prev_input = _mm_setzero_si128();
+    bool prev_ascii = true;
+
+    for (size_t i = 0; i < length; i += 16) {
+        __m128i input;
+        if (length - i >= 16) {
+            input = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data+i));
+        } else {
+            uint8_t tail[16] = {0};
+            std::copy(data+i,data+length,tail);
+            input = _mm_loadu_si128(reinterpret_cast<__m128i const *>(tail));
+        }
+
+        bool ascii = _mm_movemask_epi8(input) == 0;
+        if (!ascii || !prev_ascii) {
+            error = _mm_or_si128(error,check_block_ssse3(input,prev_input));
+        }
+        prev_input = input;
+        prev_ascii = ascii;
+    }
+
+    if (!prev_ascii) {
+        error = _mm_or_si128(error,
+            check_block_ssse3(_mm_setzero_si128(),prev_input));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error,_mm_setzero_si128()))
+        == 0xFFFF;
+}
+
+/// Find the errors in one 32 byte block given the preceding block (AVX2)
+__attribute__((target("avx2")))
+inline __m256i check_block_avx2(__m256i input, __m256i prev_input) {
+    __m256i const low_nibble = _mm256_set1_epi8(0x0F);
+    __m256i const t1h = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(byte_1_high)));
+    __m256i const t1l = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(byte_1_low)));
+    __m256i const t2h = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(byte_2_high)));
+
+    // alignr works within 128 bit lanes, so pair each lane with the lane
+    // that precedes it: (prev_input.high, input.low)
+    __m256i shifted = _mm256_permute2x128_si256(prev_input,input,0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input,shifted,15);
+    __m256i special = _mm256_and_si256(_mm256_and_si256(
+        _mm256_shuffle_epi8(t1h,
+            _mm256_and_si256(_mm256_srli_epi16(prev1,4),low_nibble)),
+        _mm256_shuffle_epi8(t1l,_mm256_and_si256(prev1,low_nibble))),
+        _mm256_shuffle_epi8(t2h,
+            _mm256_and_si256(_mm256_srli_epi16(input,4),low_nibble)));
+
+    __m256i prev2 = _mm256_alignr_epi8(input,shifted,14);
+    __m256i prev3 = _mm256_alignr_epi8(input,shifted,13);
+    __m256i must23 = _mm256_or_si256(
+        _mm256_subs_epu8(prev2,_mm256_set1_epi8(static_cast<char>(0xE0-0x80))),
+        _mm256_subs_epu8(prev3,_mm256_set1_epi8(static_cast<char>(0xF0-0x80))));
+    __m256i must23_80 = _mm256_and_si256(must23,
+        _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must23_80,special);
+}
+
+/// Validate a buffer 32 bytes at a time (AVX2)
+/**
+ * @see validate_ssse3
+ */
+__attribute__((target("avx2")))
+inline bool validate_avx2(uint8_t const * data, size_t length) {
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    bool prev_ascii = true;
+
+    for (size_t i = 0; i < length; i += 32) {
+        __m256i input;
+        if (length - i >= 32) {
+            input = _mm256_loadu_si256(
+                reinterpret_cast<__m256i const *>(data+i));
+        } else {
+            uint8_t tail[32] = {0};
+            std::copy(data+i,data+length,tail);
+            input = _mm256_loadu_si256(
+                reinterpret_cast<__m256i const *>(tail));
+        }
+
+        bool ascii = _mm256_movemask_epi8(input) == 0;
+        if (!ascii || !prev_ascii) {
+            error = _mm256_or_si256(error,check_block_avx2(input,prev_input));
+        }
+        prev_input = input;
+        prev_ascii = ascii;
+    }
+
+    if (!prev_ascii) {
+        error = _mm256_or_si256(error,
+            check_block_avx2(_mm256_setzero_si256(),prev_input));
+    }
+    bool valid = _mm256_testz_si256(error,error) != 0;
+    _mm256_zeroupper();
+    return valid;
+}
+
+/// Detect the widest validation kernel supported by the running CPU
+/**
+ * @return 32 for AVX2, 16 for SSSE3, 0 for the state machine only
+ */
+inline size_t block_size() {
+    static size_t const size = __builtin_cpu_supports("avx2") ? 32 :
+        (__builtin_cpu_supports("ssse3") ? 16 : 0);
+    return size;
+}
+
+} // namespace simd
+#endif // _WEBSOCKETPP_SIMD_UTF8_
+
 /// Provides streaming UTF8 validation functionality
 class validator {
 public:
@@ -117,6 +342,61 @@ public:
         return true;
     }
 
+    /// Advance validator state with input from a contiguous buffer
+    /**
+     * Equivalent to the iterator version but validates whole blocks with the
+     * widest SIMD kernel supported by the running CPU (AVX2, then SSSE3).
+     * Runs of ASCII are skipped a block at a time. The state machine is only
+     * used to finish a sequence left open by the previous call and for the
+     * bytes after the last whole block, so streaming across calls behaves
+     * exactly as with the byte at a time validator.
+     *
+     * @param begin Pointer to the start of the input range
+     * @param end Pointer to the end of the input range
+     * @return Whether or not decoding the bytes resulted in a validation error.
+     */
+    bool decode (char const * begin, char const * end) {
+        uint8_t const * p = reinterpret_cast<uint8_t const *>(begin);
+        uint8_t const * e = reinterpret_cast<uint8_t const *>(end);
+
+#ifdef _WEBSOCKETPP_SIMD_UTF8_
+        // finish the sequence left open by the previous call
+        while (p != e && m_state != utf8_accept) {
+            if (!consume(*p++)) {
+                return false;
+            }
+        }
+
+        size_t block = simd::block_size();
+        if (block != 0 && static_cast<size_t>(e - p) >= block) {
+            // stop before a sequence that may continue in the next call; the
+            // state machine picks it up from there
+            uint8_t const * cut = e;
+            for (int k = 1; k <= 3 && e - k >= p; ++k) {
+                uint8_t byte = *(e - k);
+                if (byte < 0x80) {
+                    break;
+                }
+                if (byte >= 0xC0) {
+                    cut = e - k;
+                    break;
+                }
+            }
+
+            bool valid = block == 32 ?
+                simd::validate_avx2(p,cut - p) :
+                simd::validate_ssse3(p,cut - p);
+            if (!valid) {
+                m_state = utf8_reject;
+                return false;
+            }
+            p = cut;
+        }
+#endif
+
+        return decode<uint8_t const *>(p,e);
+    }
+
     /// Return whether the input sequence ended on a valid utf8 codepoint
     /**
      * @return Whether or not the input sequence ended on a valid codepoint.
@@ -142,7 +422,7 @@ private:
  */
 inline bool validate(std::string const & s) {
     validator v;
-    if (!v.decode(s.begin(),s.end())) {
+    if (!v.decode(s.data(),s.data()+s.size())) {
         return false;
     }
     return v.complete();
@@ -7,6 +7,7 @@
  * 本demo测试运行时所依赖的第三方库及其版本如下：
  * boost 1.69.0
  * libssl-dev 1.1.1
+ * zlib 1.2.11（websocketpp的permessage-deflate扩展）
  * websocketpp 0.8.1
  * opus 1.3.1（本Demo编码方案采取的opus）
  * 注：测试时，websocketpp 0.8.1最高兼容的版本是1.69.0，具体查看：https://github.com/zaphoyd/websocketpp/issues
@@ -19,10 +20,13 @@
  */
 
 // 编译运行前，请填写相关参数
-// g++ iat_wss_cpp_ogg_demo.cpp -lboost_system -lpthread -lcrypto -lssl -lopus -I ../include/ -L ../lib/
+// g++ iat_wss_cpp_ogg_demo.cpp -lboost_system -lpthread -lcrypto -lssl -lz -lopus -I ../include/ -L ../lib/
 #include "iflytek_wssclient.hpp"
 #include "iflytek_ogg_opus.hpp"
 #include "iflytek_utils.hpp"
+#include "iflytek_auth.hpp"
+#include "iflytek_envelope.hpp"
+#include "iflytek_result.hpp"
 #include "json.hpp"
 
 #include "opus/opus.h"
@@ -34,7 +38,7 @@ using json = nlohmann::json;
  * 定义部分
  * 
  * 语音听写，所涉及参数的定义
- * 用于wss通信类iat_client的定义
+ * 用于wss通信会话类iat_session的定义
  ***************************************************
  */
 // 接口鉴权参数
@@ -84,35 +88,67 @@ struct DATA_INFO
 struct OTHER_INFO
 {
     string audio_file;
+    int session_count;   // 并发会话数，每个会话独立识别一次audio_file
+    int thread_count;    // 运行io_service的线程数
+    int max_concurrency; // 同时运行的最大会话数，0表示不限制
+    int pool_size;       // 每个服务预先保持的已就绪连接数，0表示不使用连接池
+    ogg_flush_policy page_policy; // ogg页的输出策略：最大缓存时长（毫秒）、最大段数、最大字节数，0表示不限制
+    double frame_duration;        // 每个opus包的帧时长（毫秒），可取2.5、5、10、20、40、60、80、100、120
 } OTHER{
-    audio_file : "../bin/audio/iat_pcm_16k.pcm"
+    audio_file : "../bin/audio/iat_pcm_16k.pcm",
+    session_count : 1,
+    thread_count : 1,
+    max_concurrency : 0,
+    pool_size : 0,
+    page_policy : {100, MAX_SEGMENTS, 0},
+    frame_duration : 20
 };
 
-// iat_client类，继承于iflytek_wssclient
-// 用于与服务器进行websocket(wss)通信
-class iat_client : public iflytek_wssclient
+// iat_session类，继承于iflytek_session
+// 每个对象对应一次与服务器的websocket(wss)会话
+class iat_session : public iflytek_session
 {
 public:
-    iat_client(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER);
+    iat_session(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER);
+    ~iat_session();
 
-protected:
-    // 需要重写如下的iflytek_wssclient的纯虚函数
+    // 需要重写如下的iflytek_session的纯虚函数
     string get_url();
-    void send_data(websocketpp::connection_hdl hdl);
+    int send_data(websocketpp::connection_hdl hdl);
     void on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg);
 
 private:
+    bool send_page(websocketpp::connection_hdl hdl, const ogg_page &op);
+    void send_release();
+
     API_IFNO API;
     COMMON_INFO COMMON;
     BUSINESS_INFO BUSINESS;
     DATA_INFO DATA;
     OTHER_INFO OTHER;
+
+    // 发送状态，send_data每次编码一帧，编码器、音频文件、缓冲区及ogg封装器在帧之间保持
+    FILE *fin;
+    OpusEncoder *enc;
+    unsigned char *pcm, *opus;
+    int sample_rate, channel, frame_size, pcm_length;
+    long long frame_us, sent_us;
+    char *page;
+    ogg_opus_muxer *muxer;
+
+    // 第一帧及之后各帧的json信封模板，以及在帧之间复用的发送缓冲区
+    iflytek_envelope first_envelope, next_envelope;
+    string send_buffer;
+
+    // 会话状态，结果消息直接解析到result中
+    int recv_count;
+    iflytek_iat_result result;
 };
 
 /***************************************************
  * 主函数部分
  * 
- * 定义iat_client类对象
+ * 定义iflytek_wssclient对象，添加iat_session会话
  * 运行客户端
  ***************************************************
  */
@@ -120,214 +156,226 @@ int main(int argc, char *argv[])
 {
     time_t start_time = clock();
 
-    iat_client client(API, COMMON, BUSINESS, DATA, OTHER);
+    iflytek_wssclient client(OTHER.thread_count, OTHER.max_concurrency);
+    client.set_pool(OTHER.pool_size);
+    for (int i = 0; i < OTHER.session_count; i++)
+    {
+        client.add_session(websocketpp::lib::make_shared<iat_session>(API, COMMON, BUSINESS, DATA, OTHER));
+    }
     client.run_client();
 
     time_t end_time = clock();
     fprintf(stdout, "[INFO] Time used: %fs\n", (double)(end_time - start_time) / CLOCKS_PER_SEC);
 
-    return 0;
+    return client.get_fail_count() == 0 ? 0 : 1;
 }
 
 /***************************************************
- * iat_client类实现部分
+ * iat_session类实现部分
  * 
- * 实现iat_client类的相关函数
+ * 实现iat_session类的相关函数
  *********************************************
  */
 /**
  * @brief 构造函数
  * 对语音听写API所涉及参数的初始化
  */
-iat_client::iat_client(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER)
-    : API(API), COMMON(COMMON), BUSINESS(BUSINESS), DATA(DATA), OTHER(OTHER)
+iat_session::iat_session(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER)
+    : API(API), COMMON(COMMON), BUSINESS(BUSINESS), DATA(DATA), OTHER(OTHER),
+      fin(NULL), enc(NULL), pcm(NULL), opus(NULL), sample_rate(16000), channel(1), sent_us(0), page(NULL), muxer(NULL),
+      recv_count(0)
 {
+    // 经测试，目前讯飞云引擎opus编解码只支持帧时长为20ms的数据，ogg封装后的帧时长由OTHER.frame_duration设置
+    // 通过表达式可以看出，对于位深16，单声道的音频来说，source_length = frame_size * 2
+    this->frame_size = this->sample_rate * this->OTHER.frame_duration / 1000;
+    this->pcm_length = this->frame_size * 2 * this->channel;
+    this->frame_us = this->OTHER.frame_duration * 1000;
+
+    // 帧标识和ogg页在发送时写入，其余字段在会话期间不变
+    json first = {
+        {"common", {{"app_id", this->COMMON.APPID}}},
+        {"business", {{"language", this->BUSINESS.language}, {"domain", this->BUSINESS.domain}, {"accent", this->BUSINESS.accent}}},
+        {"data", {
+                     {"status", iflytek_envelope::status_placeholder},
+                     {"format", this->DATA.format},
+                     {"encoding", this->DATA.encoding},
+                     {"audio", iflytek_envelope::payload_placeholder()},
+                 }}};
+    json next = {
+        {"data", {
+                     {"status", iflytek_envelope::status_placeholder},
+                     {"format", this->DATA.format},
+                     {"encoding", this->DATA.encoding},
+                     {"audio", iflytek_envelope::payload_placeholder()},
+                 }}};
+    this->first_envelope.compile(first);
+    this->next_envelope.compile(next);
 }
 
 /**
- * @brief 获得建立连接的鉴权url
- * @return 鉴权url
+ * @brief 析构函数
+ * 释放发送过程中未释放的资源
  */
-string iat_client::get_url()
+iat_session::~iat_session()
 {
-    // 生成RFC1123格式的时间戳，"Thu, 05 Dec 2019 09:54:17 GMT"
-    time_t rawtime = time(NULL);
-    char buf[1024];
-    strftime(buf, sizeof(buf), "%a, %d %b %Y %X %Z", gmtime(&rawtime));
-    string date = string(buf);
-
-    // 拼接signature的原始字符串
-    string signature_origin = "host: iat-api.xfyun.cn\n";
-    signature_origin += "date: " + date + "\n";
-    signature_origin += "GET /v2/iat HTTP/1.1";
-
-    // 使用hmac-sha256算法结合apiSecret对signature_origin签名，获得签名后的摘要signature_sha
-    string signature_sha = get_hmac_sha256(signature_origin, API.APISecret);
-
-    // 使用base64编码对signature_sha进行编码获得最终的signature
-    string signature = get_base64_encode(signature_sha);
-
-    // 拼接authorization的原始字符串
-    sprintf(buf, "api_key=\"%s\", algorithm=\"%s\", headers=\"%s\", signature=\"%s\"",
-            API.APIKey.c_str(), "hmac-sha256", "host date request-line", signature.c_str());
-    string authorization_origin = string(buf);
+    this->send_release();
+}
 
-    // 再对authorization_origin进行base64编码获得最终的authorization参数
-    string authorization = get_base64_encode(authorization_origin);
+/**
+ * @brief 释放编码器、音频文件及缓冲区
+ */
+void iat_session::send_release()
+{
+    if (this->enc != NULL)
+    {
+        opus_encoder_destroy(this->enc);
+        this->enc = NULL;
+    }
+    if (this->fin != NULL)
+    {
+        fclose(this->fin);
+        this->fin = NULL;
+    }
+    delete[] this->pcm;
+    delete[] this->opus;
+    delete this->muxer;
+    delete[] this->page;
+    this->pcm = NULL;
+    this->opus = NULL;
+    this->muxer = NULL;
+    this->page = NULL;
+}
 
-    // 对相关参数构成url，并进行url编码，生成最终鉴权url
-    sprintf(buf, "authorization=%s&date=%s&host=%s",
-            authorization.c_str(), date.c_str(), "iat-api.xfyun.cn");
-    string url = "wss://iat-api.xfyun.cn/v2/iat?" + get_url_encode(string(buf));
+/**
+ * @brief 获得建立连接的鉴权url
+ * @return 鉴权url
+ */
+string iat_session::get_url()
+{
+    // 所有会话共享同一个鉴权url生成器，hmac的内外填充状态在第一次调用时按APISecret计算一次
+    static iflytek_authorizer authorizer("iat-api.xfyun.cn", "/v2/iat", this->API.APIKey, this->API.APISecret);
 
-    return url;
+    // 生成带RFC1123格式时间戳（例如"Thu, 05 Dec 2019 09:54:17 GMT"）的鉴权url
+    char url[1024];
+    size_t length = authorizer.get_url(url, sizeof(url));
+    return string(url, length);
 }
 
 /**
- * @brief 向服务器发送数据
+ * @brief 将封装好的ogg页发送给服务器
+ * 带流开始标志的页作为第一帧，带流结束标志的页作为最后一帧，其余为中间帧
  * @param hdl 当前连接的句柄
+ * @param op 封装好的ogg页
+ * @return 发送成功时返回true，连接已关闭时返回false
  */
-void iat_client::send_data(websocketpp::connection_hdl hdl)
+bool iat_session::send_page(websocketpp::connection_hdl hdl, const ogg_page &op)
 {
-    fprintf(stdout, "[INFO] Sending audio data to server...\n");
+    int status = (op.header[5] & 0x02) ? 0 : ((op.header[5] & 0x04) ? 2 : 1);
 
-    FILE *fin = fopen(this->OTHER.audio_file.c_str(), "rb");
-    if (fin == NULL)
-    {
-        // 文件打开错误
-        fprintf(stderr, "[ERROR] Failed to open the file \"%s\"\n", this->OTHER.audio_file.c_str());
-        exit(1);
-    }
+    // 第一帧携带common和business，中间帧、最后一帧只携带data
+    const iflytek_envelope &envelope = status == 0 ? this->first_envelope : this->next_envelope;
+    envelope.serialize(status, (const unsigned char *)op.header, op.header_length + op.body_length, this->send_buffer);
 
-    char temp[27 + 255 + 255 * 255];
-    int sample_rate = 16000;
-    int channel = 1;
-    // 经测试，目前讯飞云引擎opus编解码只支持帧时长为20ms的数据
-    // 通过表达式可以看出，对于位深16，单声道的音频来说，source_length = frame_size * 2
-    int frame_size = sample_rate * 0.02;
-    int pcm_length = sample_rate / 8 * 16 * channel * 0.02;
-    json data;
-
-    ogg_logic_stream os;
-    ogg_page op;
-    init_ogg_logic_stream(os);
-    // init_ogg_page(op);
-
-    /* send page of opushead */
-    init_ogg_page(op);
-    opus_id_header id_header{1, (__uint8_t)channel, 312, (__uint32_t)sample_rate, 0, 0};
-    ogg_page_put_id_header(op, id_header);
-    ogg_page_encapsulate(os, op);
-    os.page_flag = 0x00;
-    memcpy(temp, op.header, op.header_length);
-    memcpy(temp + op.header_length, op.body, op.body_length);
-    // 第一帧处理
-    data = {
-        {"common", {{"app_id", this->COMMON.APPID}}},
-        {"business", {{"language", this->BUSINESS.language}, {"domain", this->BUSINESS.domain}, {"accent", this->BUSINESS.accent}}},
-        {"data", {
-                     {"status", 0},
-                     {"format", this->DATA.format},
-                     {"encoding", this->DATA.encoding},
-                     {"audio", get_base64_encode(string(temp, op.header_length + op.body_length))},
-                 }}};
-    this->wssclient.send(hdl, data.dump(), websocketpp::frame::opcode::text);
-
-    /* send page of opustags */
-    init_ogg_page(op);
-    char *encoder_info = (char *)"libopus 1.3.1";
-    char *comments[] = {
-        (char *)"ARTIST=zghong",
-        (char *)"TITLE=iflytek_ogg"};
-    opus_comment_header comment_header{(__uint32_t)strlen(encoder_info), encoder_info, 2, comments};
-    ogg_page_put_comment_header(op, comment_header);
-    ogg_page_encapsulate(os, op);
-    memcpy(temp, op.header, op.header_length);
-    memcpy(temp + op.header_length, op.body, op.body_length);
-    // 中间帧处理
-    data = {
-        {"data", {
-                     {"status", 1},
-                     {"format", this->DATA.format},
-                     {"encoding", this->DATA.encoding},
-                     {"audio", get_base64_encode(string(temp, op.header_length + op.body_length))},
-                 }}};
-    this->wssclient.send(hdl, data.dump(), websocketpp::frame::opcode::text);
-
-    /* send page of data */
-    init_ogg_page(op);
-    // 创建opus编码器
-    int err;
-    OpusEncoder *enc = opus_encoder_create(sample_rate, channel, OPUS_APPLICATION_VOIP, &err);
-    if (OPUS_OK != err)
+    websocketpp::lib::error_code ec;
+    this->wssclient->send(hdl, this->send_buffer.data(), this->send_buffer.size(), websocketpp::frame::opcode::text, ec);
+    if (ec)
     {
-        fprintf(stderr, "[ERROR] Failed to create OPUS Encoder\n");
-        fclose(fin);
-        exit(1);
+        // 连接已关闭（服务器报错或超时），停止发送
+        fprintf(stderr, "\n[ERROR] Session %d: Failed to send data: \"%s\"\n", this->id, ec.message().c_str());
+        return false;
     }
-    // 音频数据帧缓冲区
-    unsigned char *pcm = new unsigned char[pcm_length];
-    unsigned char *opus = new unsigned char[pcm_length];
+    return true;
+}
 
-    int size;
-    while (!feof(fin))
+/**
+ * @brief 向服务器发送数据
+ * 第一次调用时创建ogg封装器并发送opushead页和opustags页，之后每次编码一帧opus数据交给封装器，页满足page_policy时发送
+ * @param hdl 当前连接的句柄
+ * @return 距编码下一帧的毫秒数，返回-1表示发送结束
+ */
+int iat_session::send_data(websocketpp::connection_hdl hdl)
+{
+    if (this->fin == NULL)
     {
-        delay(0.02); // 模拟音频采样间隔
-        if ((size = fread(pcm, sizeof(char), pcm_length, fin)) == 0)
+        fprintf(stdout, "[INFO] Session %d: Sending audio data to server...\n", this->id);
+
+        this->fin = fopen(this->OTHER.audio_file.c_str(), "rb");
+        if (this->fin == NULL)
         {
-            break;
+            // 文件打开错误
+            fprintf(stderr, "[ERROR] Session %d: Failed to open the file \"%s\"\n", this->id, this->OTHER.audio_file.c_str());
+            this->close(hdl, "file error");
+            return -1;
         }
-        // 音频编解码
-        opus_int32 nbytes = opus_encode(enc, (opus_int16 *)pcm, frame_size, opus, pcm_length);
-        if (nbytes < 0)
+
+        // 创建opus编码器
+        int err;
+        this->enc = opus_encoder_create(this->sample_rate, this->channel, OPUS_APPLICATION_VOIP, &err);
+        if (OPUS_OK != err)
         {
-            fprintf(stderr, "[ERROR] Failed to opus_encode raw data\n");
-            opus_encoder_destroy(enc);
-            delete[] pcm;
-            delete[] opus;
-            fclose(fin);
-            exit(1);
+            fprintf(stderr, "[ERROR] Session %d: Failed to create OPUS Encoder\n", this->id);
+            this->enc = NULL;
+            this->send_release();
+            this->close(hdl, "encoder error");
+            return -1;
         }
-
-        if (ogg_page_put_packet(os, op, (char *)opus, nbytes) == 0)
+        // 音频数据帧缓冲区
+        this->pcm = new unsigned char[this->pcm_length];
+        this->opus = new unsigned char[this->pcm_length];
+
+        // 创建ogg封装器，页缓冲区按输出策略分配，封装好的整页直接进行base64编码并发送给服务器
+        size_t page_size = ogg_opus_muxer::get_buffer_size(this->OTHER.page_policy);
+        this->page = new char[page_size];
+        this->muxer = new ogg_opus_muxer(this->page, page_size, this->OTHER.page_policy, [this, hdl](const ogg_page &op) {
+            return this->send_page(hdl, op);
+        });
+
+        /* send page of opushead and opustags */
+        opus_id_header id_header{1, (__uint8_t)this->channel, 312, (__uint32_t)this->sample_rate, 0, 0};
+        char *encoder_info = (char *)"libopus 1.3.1";
+        char *comments[] = {
+            (char *)"ARTIST=zghong",
+            (char *)"TITLE=iflytek_ogg"};
+        opus_comment_header comment_header{(__uint32_t)strlen(encoder_info), encoder_info, 2, comments};
+        if (this->muxer->put_header(id_header, comment_header) == -1)
         {
-            continue;
+            this->send_release();
+            return -1;
         }
-        // send the page to server
-        ogg_page_encapsulate(os, op);
-        memcpy(temp, op.header, op.header_length);
-        memcpy(temp + op.header_length, op.body, op.body_length);
-        // 中间帧处理
-        data = {
-            {"data", {
-                         {"status", 1},
-                         {"format", this->DATA.format},
-                         {"encoding", this->DATA.encoding},
-                         {"audio", get_base64_encode(string(temp, op.header_length + op.body_length))},
-                     }}};
-        this->wssclient.send(hdl, data.dump(), websocketpp::frame::opcode::text);
-        // init a new page
-        init_ogg_page(op);
-        ogg_page_put_packet(os, op, (char *)opus, nbytes);
+        return 20; // 模拟音频采样间隔
+    }
+
+    int size;
+    if ((size = fread(this->pcm, sizeof(char), this->pcm_length, this->fin)) == 0)
+    {
+        // 最后一帧处理
+        this->muxer->finish();
+        this->send_release();
+        return -1;
+    }
+
+    // 音频编解码
+    opus_int32 nbytes = opus_encode(this->enc, (opus_int16 *)this->pcm, this->frame_size, this->opus, this->pcm_length);
+    if (nbytes < 0)
+    {
+        fprintf(stderr, "[ERROR] Session %d: Failed to opus_encode raw data: %s\n", this->id, opus_strerror(nbytes));
+        this->send_release();
+        this->close(hdl, "encoder error");
+        return -1;
+    }
+
+    // 页满足输出条件时由封装器发送给服务器
+    if (this->muxer->put_packet((char *)this->opus, nbytes) == -1)
+    {
+        this->send_release();
+        return -1;
     }
-    os.page_flag = 0x04;
-    ogg_page_encapsulate(os, op);
-    memcpy(temp, op.header, op.header_length);
-    memcpy(temp + op.header_length, op.body, op.body_length);
-    // 最后一帧处理
-    data = {
-        {"data", {
-                     {"status", 2},
-                     {"format", this->DATA.format},
-                     {"encoding", this->DATA.encoding},
-                     {"audio", get_base64_encode(string(temp, op.header_length + op.body_length))},
-                 }}};
-    this->wssclient.send(hdl, data.dump(), websocketpp::frame::opcode::text);
 
-    opus_encoder_destroy(enc);
-    delete[] pcm;
-    delete[] opus;
-    fclose(fin);
+    // 模拟音频采样间隔，按累计的音频时长取整到毫秒，2.5ms等非整数帧时长不会累积误差
+    long long next_us = this->sent_us + this->frame_us;
+    int interval = next_us / 1000 - this->sent_us / 1000;
+    this->sent_us = next_us;
+    return interval;
 }
 
 /**
@@ -335,50 +383,39 @@ void iat_client::send_data(websocketpp::connection_hdl hdl)
  * @param hdl 当前连接的句柄
  * @param msg 服务器数据的句柄
  */
-void iat_client::on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg)
+void iat_session::on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg)
 {
-    static int cnt = 0;
-    fprintf(stdout, "\r[INFO] WebSocket's STATE is ON_MESSAGE, No.%d frame received", ++cnt);
+    fprintf(stdout, "\r[INFO] Session %d: WebSocket's STATE is ON_MESSAGE, No.%d frame received", this->id, ++this->recv_count);
     fflush(stdout);
 
-    json recv_data = json::parse(msg->get_payload());
-    static string sid = recv_data["sid"];
-    static string result_str = "";
-    int code = recv_data["code"];
-
-    // 拼接结果
-    if (code == 0)
+    if (this->result.parse(msg->get_payload()) == -1)
     {
-        json result = recv_data["data"]["result"]["ws"];
-        for (auto &temp : result)
-        {
-            result_str += temp["cw"][0]["w"];
-        }
+        // 客户端主动关闭连接
+        this->close(hdl, "receive over");
 
+        fprintf(stderr, "\n[ERROR] Session %d: sid: \"%s\" invalid result message: %s\n", this->id, this->result.get_sid().c_str(), msg->get_payload().c_str());
+        return;
+    }
+
+    // 识别出的词已在解析时拼接到结果中
+    if (this->result.get_code() == 0)
+    {
         // 是否是最后一片结果
-        if (recv_data["data"]["result"]["ls"])
+        if (this->result.is_last())
         {
             // 客户端主动关闭连接
-            asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl);
-            if (con != NULL && con->get_state() == websocketpp::session::state::value::open)
-            {
-                con->close(0, "receive over");
-            }
+            this->success = true;
+            this->close(hdl, "receive over");
 
             // 输出最终结果
-            fprintf(stdout, "\n[SUCCESS] sid: \"%s\" call success. Result is \"%s\"\n", sid.c_str(), result_str.c_str());
+            fprintf(stdout, "\n[SUCCESS] Session %d: sid: \"%s\" call success. Result is \"%s\"\n", this->id, this->result.get_sid().c_str(), this->result.get_text().c_str());
         }
     }
     else
     {
         // 客户端主动关闭连接
-        asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl);
-        if (con != NULL && con->get_state() == websocketpp::session::state::value::open)
-        {
-            con->close(0, "receive over");
-        }
+        this->close(hdl, "receive over");
 
-        cout << "\n[ERROR] sid: \"" << sid << "\" call error. ERROR_CODE: \"" << code << "\", ERROR_MSG: " << recv_data["message"] << endl;
-        exit(1);
+        cout << "\n[ERROR] Session " << this->id << ": sid: \"" << this->result.get_sid() << "\" call error. ERROR_CODE: \"" << this->result.get_code() << "\", ERROR_MSG: \"" << this->result.get_message() << "\"" << endl;
     }
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
  * 本demo测试运行时所安装的第三方库及其版本如下：
  * boost 1.69.0
  * libssl-dev 1.1.1
+ * zlib 1.2.11（websocketpp的permessage-deflate扩展）
  * websocketpp 0.8.1
  * speex 1.2.0（本Demo编码方案采取的speex）
  * 注：测试时，websocketpp 0.8.1最高兼容的版本是1.69.0，具体查看：https://github.com/zaphoyd/websocketpp/issues
@@ -17,10 +18,13 @@
  */
 
 // 编译运行前，请填写相关参数
-// g++ igr_wss_cpp_demo.cpp -lboost_system -lpthread -lcrypto -lssl -lopus -lspeex -I ../include/ -L ../lib/
+// g++ igr_wss_cpp_demo.cpp -lboost_system -lpthread -lcrypto -lssl -lz -lopus -lspeex -I ../include/ -L ../lib/
 #include "iflytek_wssclient.hpp"
 #include "iflytek_codec.hpp"
+#include "iflytek_resampler.hpp"
 #include "iflytek_utils.hpp"
+#include "iflytek_auth.hpp"
+#include "iflytek_envelope.hpp"
 #include "json.hpp"
 
 using namespace std;
@@ -30,7 +34,7 @@ using json = nlohmann::json;
  * 定义部分
  * 
  * 性别年龄识别，所涉及参数的定义
- * 用于wss通信类igr_client的定义
+ * 用于wss通信会话类igr_session的定义
  ***************************************************
  */
 // 接口鉴权参数
@@ -73,35 +77,74 @@ struct DATA_INFO
 struct OTHER_INFO
 {
     string audio_file;
+    int session_count;   // 并发会话数，每个会话独立识别一次audio_file
+    int thread_count;    // 运行io_service的线程数
+    int max_concurrency; // 同时运行的最大会话数，0表示不限制
+    int pool_size;       // 每个服务预先保持的已就绪连接数，0表示不使用连接池
+    int frames_per_send; // 每条消息发送的音频帧数（每帧20ms），一次批量编码，增大可减少消息数
+    int input_rate;      // audio_file的采样率，与编码器不同时先重采样，0表示与编码器相同
 } OTHER{
-    audio_file : "../bin/audio/iat_pcm_16k.pcm"
+    audio_file : "../bin/audio/iat_pcm_16k.pcm",
+    session_count : 1,
+    thread_count : 1,
+    max_concurrency : 0,
+    pool_size : 0,
+    frames_per_send : 1,
+    input_rate : 0
 };
 
-// igr_client类，继承于iflytek_wssclient
-// 用于与服务器进行websocket(wss)通信
-class igr_client : public iflytek_wssclient
+// igr_session类，继承于iflytek_session
+// 每个对象对应一次与服务器的websocket(wss)会话
+class igr_session : public iflytek_session
 {
 public:
-    igr_client(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER);
+    igr_session(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER);
+    ~igr_session();
 
-protected:
-    // 需要重写如下的iflytek_wssclient的纯虚函数
+    // 需要重写如下的iflytek_session的纯虚函数
     string get_url();
-    void send_data(websocketpp::connection_hdl hdl);
+    int send_data(websocketpp::connection_hdl hdl);
     void on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg);
 
 private:
+    void send_release();
+
     API_IFNO API;
     COMMON_INFO COMMON;
     BUSINESS_INFO BUSINESS;
     DATA_INFO DATA;
     OTHER_INFO OTHER;
+
+    // 帧标识，标识音频是第一帧，还是中间帧、最后一帧
+    enum STATUS_INFO
+    {
+        STATUS_FIRST_FRAME,    // 第一帧的标识
+        STATUS_CONTINUE_FRAME, // 中间帧标识
+        STATUS_LAST_FRAME,     // 最后一帧的标识
+    } current_status;
+
+    // 发送状态，send_data每次发送frames_per_send帧，编码器、音频文件、重采样器、缓冲区及各帧的偏移在帧之间保持
+    iflytek_codec *codec;
+    FILE *fin;
+    iflytek_resampler *resampler;
+    unsigned char *pcm, *speex;
+    int pcm_length;
+    vector<int> frame_offsets;
+    int send_count;
+
+    // 第一帧及之后各帧的json信封模板，以及在帧之间复用的发送缓冲区
+    iflytek_envelope first_envelope, next_envelope;
+    string send_buffer;
+
+    // 会话状态
+    int recv_count;
+    string sid;
 };
 
 /***************************************************
  * 主函数部分
  * 
- * 定义igr_client类对象
+ * 定义iflytek_wssclient对象，添加igr_session会话
  * 运行客户端
  ***************************************************
  */
@@ -109,190 +152,210 @@ int main(int argc, char *argv[])
 {
     time_t start_time = clock();
 
-    igr_client client(API, COMMON, BUSINESS, DATA, OTHER);
+    iflytek_wssclient client(OTHER.thread_count, OTHER.max_concurrency);
+    client.set_pool(OTHER.pool_size);
+    for (int i = 0; i < OTHER.session_count; i++)
+    {
+        client.add_session(websocketpp::lib::make_shared<igr_session>(API, COMMON, BUSINESS, DATA, OTHER));
+    }
     client.run_client();
 
     time_t end_time = clock();
     fprintf(stdout, "[INFO] Time used: %fs\n", (double)(end_time - start_time) / CLOCKS_PER_SEC);
 
-    return 0;
+    return client.get_fail_count() == 0 ? 0 : 1;
 }
 
 /***************************************************
- * igr_client类实现部分
+ * igr_session类实现部分
  * 
- * 实现igr_client类的相关函数
+ * 实现igr_session类的相关函数
  *********************************************
  */
 /**
  * @brief 构造函数
  * 对性别年龄识别API所涉及参数的初始化
  */
-igr_client::igr_client(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER)
-    : API(API), COMMON(COMMON), BUSINESS(BUSINESS), DATA(DATA), OTHER(OTHER)
+igr_session::igr_session(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER)
+    : API(API), COMMON(COMMON), BUSINESS(BUSINESS), DATA(DATA), OTHER(OTHER),
+      current_status(STATUS_FIRST_FRAME), codec(NULL), fin(NULL), resampler(NULL), pcm(NULL), speex(NULL), pcm_length(0), send_count(0),
+      recv_count(0)
 {
+    // 帧标识和音频在发送时写入，其余字段在会话期间不变
+    json first = {
+        {"common", {{"app_id", this->COMMON.APPID}}},
+        {"business", {{"aue", this->BUSINESS.aue}, {"rate", this->BUSINESS.rate}}},
+        {"data", {
+                     {"status", iflytek_envelope::status_placeholder},
+                     {"audio", iflytek_envelope::payload_placeholder()},
+                 }}};
+    json next = {
+        {"data", {
+                     {"status", iflytek_envelope::status_placeholder},
+                     {"audio", iflytek_envelope::payload_placeholder()},
+                 }}};
+    this->first_envelope.compile(first);
+    this->next_envelope.compile(next);
 }
 
 /**
- * @brief 获得建立连接的鉴权url
- * @return 鉴权url
+ * @brief 析构函数
+ * 释放发送过程中未释放的资源
  */
-string igr_client::get_url()
+igr_session::~igr_session()
 {
-    // 生成RFC1123格式的时间戳，"Thu, 05 Dec 2019 09:54:17 GMT"
-    time_t rawtime = time(NULL);
-    char buf[1024];
-    strftime(buf, sizeof(buf), "%a, %d %b %Y %X %Z", gmtime(&rawtime));
-    string date = string(buf);
-
-    // 拼接signature的原始字符串
-    string signature_origin = "host: ws-api.xfyun.cn\n";
-    signature_origin += "date: " + date + "\n";
-    signature_origin += "GET /v2/igr HTTP/1.1";
-
-    // 使用hmac-sha256算法结合apiSecret对signature_origin签名，获得签名后的摘要signature_sha
-    string signature_sha = get_hmac_sha256(signature_origin, API.APISecret);
-
-    // 使用base64编码对signature_sha进行编码获得最终的signature
-    string signature = get_base64_encode(signature_sha);
-
-    // 拼接authorization的原始字符串
-    sprintf(buf, "api_key=\"%s\", algorithm=\"%s\", headers=\"%s\", signature=\"%s\"",
-            API.APIKey.c_str(), "hmac-sha256", "host date request-line", signature.c_str());
-    string authorization_origin = string(buf);
-
-    // 再对authorization_origin进行base64编码获得最终的authorization参数
-    string authorization = get_base64_encode(authorization_origin);
-
-    // 对相关参数构成url，并进行url编码，生成最终鉴权url
-    sprintf(buf, "authorization=%s&date=%s&host=%s",
-            authorization.c_str(), date.c_str(), "ws-api.xfyun.cn");
-    string url = "wss://ws-api.xfyun.cn/v2/igr?" + get_url_encode(string(buf));
-
-    return url;
+    this->send_release();
 }
 
 /**
- * @brief 向服务器发送数据
- * @param hdl 当前连接的句柄
+ * @brief 归还编码器，释放音频文件及缓冲区
  */
-void igr_client::send_data(websocketpp::connection_hdl hdl)
+void igr_session::send_release()
 {
-    fprintf(stdout, "[INFO] Sending audio data to server...\n");
-
-    iflytek_codec *codec = new speex_codec;
-    int pcm_length = codec->encode_create(this->BUSINESS.aue);
-    if (pcm_length == -1)
+    if (this->codec != NULL)
     {
-        delete codec;
-        exit(1);
+        iflytek_codec_pool::get_instance().put_encoder(this->BUSINESS.aue, this->codec);
+        this->codec = NULL;
     }
-
-    FILE *fin = fopen(this->OTHER.audio_file.c_str(), "rb");
-    if (fin == NULL)
+    if (this->fin != NULL)
     {
-        // 文件打开错误
-        fprintf(stderr, "[ERROR] Failed to open the file \"%s\"\n", this->OTHER.audio_file.c_str());
-        delete codec;
-        exit(1);
+        fclose(this->fin);
+        this->fin = NULL;
     }
+    delete this->resampler;
+    this->resampler = NULL;
+    delete[] this->pcm;
+    delete[] this->speex;
+    this->pcm = NULL;
+    this->speex = NULL;
+}
 
-    // 帧标识，标识音频是第一帧，还是中间帧、最后一帧
-    enum STATUS_INFO
-    {
-        STATUS_FIRST_FRAME,    // 第一帧的标识
-        STATUS_CONTINUE_FRAME, // 中间帧标识
-        STATUS_LAST_FRAME,     // 最后一帧的标识
-    } current_status = STATUS_FIRST_FRAME;
-    // 音频数据帧缓冲区
-    unsigned char *pcm = new unsigned char[pcm_length];
-    unsigned char *speex = new unsigned char[pcm_length];
+/**
+ * @brief 获得建立连接的鉴权url
+ * @return 鉴权url
+ */
+string igr_session::get_url()
+{
+    // 所有会话共享同一个鉴权url生成器，hmac的内外填充状态在第一次调用时按APISecret计算一次
+    static iflytek_authorizer authorizer("ws-api.xfyun.cn", "/v2/igr", this->API.APIKey, this->API.APISecret);
+
+    // 生成带RFC1123格式时间戳（例如"Thu, 05 Dec 2019 09:54:17 GMT"）的鉴权url
+    char url[1024];
+    size_t length = authorizer.get_url(url, sizeof(url));
+    return string(url, length);
+}
 
-    int cnt = 0;
-    while (current_status != STATUS_LAST_FRAME)
+/**
+ * @brief 向服务器发送一条数据，包含frames_per_send帧音频
+ * 第一帧发送前创建编码器、打开音频文件
+ * @param hdl 当前连接的句柄
+ * @return 距发送下一帧的毫秒数，返回-1表示发送结束
+ */
+int igr_session::send_data(websocketpp::connection_hdl hdl)
+{
+    if (this->current_status == STATUS_FIRST_FRAME && this->codec == NULL)
     {
-        int size = fread(pcm, sizeof(char), pcm_length, fin);
+        fprintf(stdout, "[INFO] Session %d: Sending audio data to server...\n", this->id);
 
-        // 音频编解码
-        int speex_length = codec->encode(pcm, pcm_length, speex);
-        if (speex_length == -1)
+        // 编码器从状态池取出，发送结束后重置并归还
+        this->codec = iflytek_codec_pool::get_instance().get_encoder(this->BUSINESS.aue, this->pcm_length);
+        if (this->codec == NULL)
         {
-            codec->encode_destroy();
-            delete codec;
-            delete[] pcm;
-            delete[] speex;
-            fclose(fin);
-            exit(1);
+            this->close(hdl, "encoder error");
+            return -1;
         }
 
-        // 读到的字节数为0，说明当前是最后一帧
-        if (!size)
+        this->fin = fopen(this->OTHER.audio_file.c_str(), "rb");
+        if (this->fin == NULL)
         {
-            current_status = STATUS_LAST_FRAME;
+            // 文件打开错误
+            fprintf(stderr, "[ERROR] Session %d: Failed to open the file \"%s\"\n", this->id, this->OTHER.audio_file.c_str());
+            this->send_release();
+            this->close(hdl, "file error");
+            return -1;
         }
 
-        // 发送相应的数据给服务器
-        switch (current_status)
+        // 编码器每帧为20ms的16位单声道音频，由帧长得到编码器的采样率
+        int codec_rate = this->pcm_length * 25;
+        if (this->OTHER.input_rate > 0 && this->OTHER.input_rate != codec_rate)
         {
-        case STATUS_FIRST_FRAME:
-        {
-            // 第一帧处理
-            json data = {
-                {"common", {{"app_id", this->COMMON.APPID}}},
-                {"business", {{"aue", this->BUSINESS.aue}, {"rate", this->BUSINESS.rate}}},
-                {"data", {
-                             {"status", 0},
-                             {"audio", get_base64_encode(string((char *)speex, speex_length))},
-                         }}};
-
-            this->wssclient.send(hdl, data.dump(), websocketpp::frame::opcode::text);
-            current_status = STATUS_CONTINUE_FRAME;
-            break;
-        }
-        case STATUS_CONTINUE_FRAME:
-        {
-            // 中间帧处理
-            json data = {
-                {"data", {
-                             {"status", 1},
-                             {"audio", get_base64_encode(string((char *)speex, speex_length))},
-                         }}};
-
-            this->wssclient.send(hdl, data.dump(), websocketpp::frame::opcode::text);
-            break;
-        }
-        case STATUS_LAST_FRAME:
-        {
-            // 最后一帧处理
-            json data = {
-                {"data", {
-                             {"status", 2},
-                             {"audio", get_base64_encode("")},
-                         }}};
-
-            this->wssclient.send(hdl, data.dump(), websocketpp::frame::opcode::text);
-            break;
-        }
+            this->resampler = new iflytek_resampler();
+            if (this->resampler->create(this->OTHER.input_rate, codec_rate) == -1)
+            {
+                this->send_release();
+                this->close(hdl, "resampler error");
+                return -1;
+            }
         }
 
-        // 输出进度
-        if (current_status != STATUS_LAST_FRAME)
-        {
-            fprintf(stdout, "\r[INFO] No.%d frame sent...", ++cnt);
-            delay(0.02); // 模拟音频采样间隔
-        }
-        else
-        {
-            fprintf(stdout, "\r[SUCCESS] No.%d frame sent，OVER\n", ++cnt);
-        }
-        fflush(stdout);
+        // 音频数据帧缓冲区，编码后每帧最多比原始数据多1字节的帧头
+        this->pcm = new unsigned char[this->pcm_length * this->OTHER.frames_per_send];
+        this->speex = new unsigned char[(this->pcm_length + 1) * this->OTHER.frames_per_send];
+    }
+
+    // 设置了input_rate时，从文件读取的音频先重采样到编码器的采样率
+    int length = this->pcm_length * this->OTHER.frames_per_send;
+    int size = this->resampler != NULL ? this->resampler->read(this->fin, this->pcm, length) : fread(this->pcm, sizeof(char), length, this->fin);
+
+    // 音频编解码，不足一帧的音频补零后与其他帧一起批量编码
+    int frames = (size + this->pcm_length - 1) / this->pcm_length;
+    memset(this->pcm + size, 0, frames * this->pcm_length - size);
+    int speex_length = this->codec->encode_batch(this->pcm, frames * this->pcm_length, this->speex, this->frame_offsets);
+    if (speex_length == -1)
+    {
+        this->send_release();
+        this->close(hdl, "encoder error");
+        return -1;
+    }
+
+    // 读到的字节数为0，说明当前是最后一帧
+    if (!size)
+    {
+        this->current_status = STATUS_LAST_FRAME;
     }
 
-    codec->encode_destroy();
-    delete codec;
-    delete[] pcm;
-    delete[] speex;
-    fclose(fin);
+    // 发送相应的数据给服务器
+    websocketpp::lib::error_code ec;
+    switch (this->current_status)
+    {
+    case STATUS_FIRST_FRAME:
+        // 第一帧处理
+        this->first_envelope.serialize(0, this->speex, speex_length, this->send_buffer);
+        this->current_status = STATUS_CONTINUE_FRAME;
+        break;
+    case STATUS_CONTINUE_FRAME:
+        // 中间帧处理
+        this->next_envelope.serialize(1, this->speex, speex_length, this->send_buffer);
+        break;
+    case STATUS_LAST_FRAME:
+        // 最后一帧处理
+        this->next_envelope.serialize(2, NULL, 0, this->send_buffer);
+        break;
+    }
+    this->wssclient->send(hdl, this->send_buffer.data(), this->send_buffer.size(), websocketpp::frame::opcode::text, ec);
+
+    // 连接已关闭（服务器报错或超时），停止发送
+    if (ec)
+    {
+        fprintf(stderr, "\n[ERROR] Session %d: Failed to send data: \"%s\"\n", this->id, ec.message().c_str());
+        this->send_release();
+        return -1;
+    }
+
+    // 输出进度
+    if (this->current_status != STATUS_LAST_FRAME)
+    {
+        fprintf(stdout, "\r[INFO] Session %d: No.%d frame sent...", this->id, ++this->send_count);
+        fflush(stdout);
+        return 20 * frames; // 模拟音频采样间隔
+    }
+    else
+    {
+        fprintf(stdout, "\r[SUCCESS] Session %d: No.%d frame sent，OVER\n", this->id, ++this->send_count);
+        fflush(stdout);
+        this->send_release();
+        return -1;
+    }
 }
 
 /**
@@ -300,14 +363,16 @@ void igr_client::send_data(websocketpp::connection_hdl hdl)
  * @param hdl 当前连接的句柄
  * @param msg 服务器数据的句柄
  */
-void igr_client::on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg)
+void igr_session::on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg)
 {
-    static int cnt = 0;
-    fprintf(stdout, "\r[INFO] WebSocket's STATE is ON_MESSAGE, No.%d frame received", ++cnt);
+    fprintf(stdout, "\r[INFO] Session %d: WebSocket's STATE is ON_MESSAGE, No.%d frame received", this->id, ++this->recv_count);
     fflush(stdout);
 
     json recv_data = json::parse(msg->get_payload());
-    static string sid = recv_data["sid"];
+    if (this->sid.empty() && recv_data["sid"].is_string())
+    {
+        this->sid = recv_data["sid"];
+    }
     int code = recv_data["code"];
 
     // 拼接结果
@@ -315,7 +380,7 @@ void igr_client::on_message(websocketpp::connection_hdl hdl, asio_tls_client::me
     {
         json result = recv_data["data"];
 
-        fprintf(stdout, "\n[SUCCESS] sid: \"%s\" call success. Result is as follows:\n", sid.c_str());
+        fprintf(stdout, "\n[SUCCESS] Session %d: sid: \"%s\" call success. Result is as follows:\n", this->id, this->sid.c_str());
 
         // 年龄
         string child_probability = result["result"]["age"]["child"];
@@ -339,23 +404,15 @@ void igr_client::on_message(websocketpp::connection_hdl hdl, asio_tls_client::me
         if (result["status"] == 2)
         {
             // 客户端主动关闭连接
-            asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl);
-            if (con != NULL && con->get_state() == websocketpp::session::state::value::open)
-            {
-                con->close(0, "receive over");
-            }
+            this->success = true;
+            this->close(hdl, "receive over");
         }
     }
     else
     {
         // 客户端主动关闭连接
-        asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl);
-        if (con != NULL && con->get_state() == websocketpp::session::state::value::open)
-        {
-            con->close(0, "receive over");
-        }
+        this->close(hdl, "receive over");
 
-        cout << "\n[ERROR] sid: \"" << sid << "\" call error. ERROR_CODE: \"" << code << "\", ERROR_MSG: " << recv_data["message"] << endl;
-        exit(1);
+        cout << "\n[ERROR] Session " << this->id << ": sid: \"" << this->sid << "\" call error. ERROR_CODE: \"" << code << "\", ERROR_MSG: " << recv_data["message"] << endl;
     }
 }
\ No newline at end of file
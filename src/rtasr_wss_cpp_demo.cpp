@@ -7,6 +7,7 @@
  * 本demo测试运行时所安装的第三方库及其版本如下：
  * boost 1.69.0
  * libssl-dev 1.1.1
+ * zlib 1.2.11（websocketpp的permessage-deflate扩展）
  * websocketpp 0.8.1
  * 注：测试时，websocketpp 0.8.1最高兼容的版本是1.69.0，具体查看：https://github.com/zaphoyd/websocketpp/issues
  * 注：项目目录已安装websocket 0.8.1；但是运行环境应该还要自行安装boost 0.8.1，libssl-dev 1.1.1
@@ -16,7 +17,7 @@
  */
 
 // 编译运行前，请填写相关参数
-// g++ rtasr_wss_cpp_demo.cpp -lboost_system -lpthread -lcrypto -lssl -lopus -lspeex -I ../include/ -L ../lib/
+// g++ rtasr_wss_cpp_demo.cpp -lboost_system -lpthread -lcrypto -lssl -lz -lopus -lspeex -I ../include/ -L ../lib/
 #include "iflytek_wssclient.hpp"
 #include "iflytek_codec.hpp"
 #include "iflytek_utils.hpp"
@@ -29,7 +30,7 @@ using json = nlohmann::json;
  * 定义部分
  * 
  * 实时语音转写，所涉及参数的定义
- * 用于wss通信类rtasr_client的定义
+ * 用于wss通信会话类rtasr_session的定义
  ***************************************************
  */
 // 接口鉴权参数
@@ -52,33 +53,52 @@ struct COMMON_INFO
 struct OTHER_INFO
 {
     string audio_file;
+    int session_count;   // 并发会话数，每个会话独立识别一次audio_file
+    int thread_count;    // 运行io_service的线程数
+    int max_concurrency; // 同时运行的最大会话数，0表示不限制
+    int pool_size;       // 每个服务预先保持的已就绪连接数，0表示不使用连接池
 } OTHER{
-    audio_file : "../bin/audio/iat_pcm_16k.pcm"
+    audio_file : "../bin/audio/iat_pcm_16k.pcm",
+    session_count : 1,
+    thread_count : 1,
+    max_concurrency : 0,
+    pool_size : 0
 };
 
-// rtasr_client类，继承于iflytek_wssclient
-// 用于与服务器进行websocket(wss)通信
-class rtasr_client : public iflytek_wssclient
+// rtasr_session类，继承于iflytek_session
+// 每个对象对应一次与服务器的websocket(wss)会话
+class rtasr_session : public iflytek_session
 {
 public:
-    rtasr_client(API_IFNO API, COMMON_INFO COMMON, OTHER_INFO OTHER);
+    rtasr_session(API_IFNO API, COMMON_INFO COMMON, OTHER_INFO OTHER);
+    ~rtasr_session();
 
-protected:
-    // 需要重写如下的iflytek_wssclient的纯虚函数
+    // 需要重写如下的iflytek_session的纯虚函数
     string get_url();
-    void send_data(websocketpp::connection_hdl hdl);
+    int send_data(websocketpp::connection_hdl hdl);
     void on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg);
 
 private:
+    void send_release();
+
     API_IFNO API;
     COMMON_INFO COMMON;
     OTHER_INFO OTHER;
+
+    // 发送状态，send_data每次发送一帧，音频文件及缓冲区在帧之间保持
+    FILE *fin;
+    unsigned char *pcm;
+    int pcm_length;
+    int send_count;
+
+    // 会话状态
+    int recv_count;
 };
 
 /*********************************************
  * 主函数部分
  * 
- * 定义rtasr_client类对象
+ * 定义iflytek_wssclient对象，添加rtasr_session会话
  * 运行客户端
  *********************************************
  */
@@ -86,35 +106,65 @@ int main(int argc, char *argv[])
 {
     time_t start_time = clock();
 
-    rtasr_client client(API, COMMON, OTHER);
+    iflytek_wssclient client(OTHER.thread_count, OTHER.max_concurrency);
+    client.set_pool(OTHER.pool_size);
+    for (int i = 0; i < OTHER.session_count; i++)
+    {
+        client.add_session(websocketpp::lib::make_shared<rtasr_session>(API, COMMON, OTHER));
+    }
     client.run_client();
 
     time_t end_time = clock();
     fprintf(stdout, "[INFO] Time used: %fs\n", (double)(end_time - start_time) / CLOCKS_PER_SEC);
 
-    return 0;
+    return client.get_fail_count() == 0 ? 0 : 1;
 }
 
 /*********************************************
- * rtasr_client类实现部分
+ * rtasr_session类实现部分
  * 
- * 实现rtasr_client类的相关函数
+ * 实现rtasr_session类的相关函数
  *********************************************
  */
 /**
  * @brief 构造函数
  * 对实时语音转写API所涉及参数的初始化
  */
-rtasr_client::rtasr_client(API_IFNO API, COMMON_INFO COMMON, OTHER_INFO OTHER)
-    : API(API), COMMON(COMMON), OTHER(OTHER)
+rtasr_session::rtasr_session(API_IFNO API, COMMON_INFO COMMON, OTHER_INFO OTHER)
+    : API(API), COMMON(COMMON), OTHER(OTHER),
+      fin(NULL), pcm(NULL), pcm_length(1280), send_count(0),
+      recv_count(0)
+{
+}
+
+/**
+ * @brief 析构函数
+ * 释放发送过程中未释放的资源
+ */
+rtasr_session::~rtasr_session()
+{
+    this->send_release();
+}
+
+/**
+ * @brief 释放音频文件及缓冲区
+ */
+void rtasr_session::send_release()
 {
+    if (this->fin != NULL)
+    {
+        fclose(this->fin);
+        this->fin = NULL;
+    }
+    delete[] this->pcm;
+    this->pcm = NULL;
 }
 
 /**
  * @brief 获得建立连接的鉴权url
  * @return 鉴权url
  */
-string rtasr_client::get_url()
+string rtasr_session::get_url()
 {
     // 生成当前时间戳
     time_t rawtime = time(NULL);
@@ -142,47 +192,59 @@ string rtasr_client::get_url()
 }
 
 /**
- * @brief 向服务器发送数据
+ * @brief 向服务器发送一帧数据
+ * 第一帧发送前打开音频文件
  * @param hdl 当前连接的句柄
+ * @return 距发送下一帧的毫秒数，返回-1表示发送结束
  */
-void rtasr_client::send_data(websocketpp::connection_hdl hdl)
+int rtasr_session::send_data(websocketpp::connection_hdl hdl)
 {
-    fprintf(stdout, "[INFO] Sending audio data to server...\n");
-
-    FILE *fin = fopen(this->OTHER.audio_file.c_str(), "rb");
-    if (fin == NULL)
+    if (this->fin == NULL)
     {
-        // 文件打开错误
-        fprintf(stderr, "[ERROR] Failed to open the file \"%s\"\n", this->OTHER.audio_file.c_str());
-        exit(1);
-    }
+        fprintf(stdout, "[INFO] Session %d: Sending audio data to server...\n", this->id);
+
+        this->fin = fopen(this->OTHER.audio_file.c_str(), "rb");
+        if (this->fin == NULL)
+        {
+            // 文件打开错误
+            fprintf(stderr, "[ERROR] Session %d: Failed to open the file \"%s\"\n", this->id, this->OTHER.audio_file.c_str());
+            this->close(hdl, "file error");
+            return -1;
+        }
 
-    // 音频数据帧缓冲区
-    int pcm_length = 1280;
-    unsigned char *pcm = new unsigned char[pcm_length];
+        // 音频数据帧缓冲区
+        this->pcm = new unsigned char[this->pcm_length];
+    }
 
-    int cnt = 0;
-    while (1)
+    int size;
+    websocketpp::lib::error_code ec;
+    if ((size = fread(this->pcm, sizeof(char), this->pcm_length, this->fin)))
     {
-        int size;
-        if (size = fread(pcm, sizeof(char), pcm_length, fin))
+        this->wssclient->send(hdl, this->pcm, size, websocketpp::frame::opcode::binary, ec);
+        if (!ec)
         {
-            this->wssclient.send(hdl, string((char *)pcm, size), websocketpp::frame::opcode::binary);
-            fprintf(stdout, "\r[INFO] No.%d frame sent...", ++cnt);
-            delay(0.04); // 模拟音频采样间隔
+            fprintf(stdout, "\r[INFO] Session %d: No.%d frame sent...", this->id, ++this->send_count);
+            fflush(stdout);
+            return 40; // 模拟音频采样间隔
         }
-        else
+    }
+    else
+    {
+        // 上传结束标志
+        this->wssclient->send(hdl, "{\"end\": true}", websocketpp::frame::opcode::text, ec);
+        if (!ec)
         {
-            // 上传结束标志
-            this->wssclient.send(hdl, "{\"end\": true}", websocketpp::frame::opcode::text);
-            fprintf(stdout, "\r[SUCCESS] No.%d frame sent，OVER\n", ++cnt);
-            break;
+            fprintf(stdout, "\r[SUCCESS] Session %d: No.%d frame sent，OVER\n", this->id, ++this->send_count);
         }
-        fflush(stdout);
     }
 
-    delete[] pcm;
-    fclose(fin);
+    // 连接已关闭（服务器报错或超时），停止发送
+    if (ec)
+    {
+        fprintf(stderr, "\n[ERROR] Session %d: Failed to send data: \"%s\"\n", this->id, ec.message().c_str());
+    }
+    this->send_release();
+    return -1;
 }
 
 /**
@@ -190,12 +252,14 @@ void rtasr_client::send_data(websocketpp::connection_hdl hdl)
  * @param hdl 当前连接的句柄
  * @param msg 服务器数据的句柄
  */
-void rtasr_client::on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg)
+void rtasr_session::on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg)
 {
-    static int cnt = 0;
-    fprintf(stdout, "\r[INFO] WebSocket's STATE is ON_MESSAGE, No.%d frame received", ++cnt);
+    fprintf(stdout, "\r[INFO] Session %d: WebSocket's STATE is ON_MESSAGE, No.%d frame received", this->id, ++this->recv_count);
     fflush(stdout);
 
     // FIXME: 返回的json对象中，'data'值为字符串，会导致json引擎解析失败，待解决
     cout << msg->get_payload() << endl;
+
+    // 服务器返回error时该会话失败，由服务器关闭连接
+    this->success = msg->get_payload().find("\"action\":\"error\"") == string::npos;
 }
\ No newline at end of file
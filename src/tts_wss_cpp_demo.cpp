@@ -7,6 +7,7 @@
  * 本demo测试运行时所安装的第三方库及其版本如下：
  * boost 1.69.0
  * libssl-dev 1.1.1
+ * zlib 1.2.11（websocketpp的permessage-deflate扩展）
  * websocketpp 0.8.1
  * speex 1.2.0（本Demo解码方案采取的speex）
  * 注：测试时，websocketpp 0.8.1最高兼容的版本是1.69.0，具体查看：https://github.com/zaphoyd/websocketpp/issues
@@ -17,10 +18,12 @@
  */
 
 // 编译运行前，请填写相关参数
-// g++ tts_wss_cpp_demo.cpp -lboost_system -lpthread -lcrypto -lssl -lspeex -I ../include/ -L ../lib/
+// g++ tts_wss_cpp_demo.cpp -lboost_system -lpthread -lcrypto -lssl -lz -lspeex -I ../include/ -L ../lib/
 #include "iflytek_wssclient.hpp"
 #include "iflytek_codec.hpp"
 #include "iflytek_utils.hpp"
+#include "iflytek_auth.hpp"
+#include "iflytek_envelope.hpp"
 #include "json.hpp"
 
 using namespace std;
@@ -30,7 +33,7 @@ using json = nlohmann::json;
  * 定义部分
  * 
  * 语音合成，所涉及参数的定义
- * 用于wss通信类tts_client的定义
+ * 用于wss通信会话类tts_session的定义
  ***************************************************
  */
 // 接口鉴权参数
@@ -88,36 +91,62 @@ struct OTHER_INFO
 {
     string text_file;
     string audio_file;
+    int session_count;   // 并发会话数，多个会话时第i个会话的语音文件保存在"audio_file.i"
+    int thread_count;    // 运行io_service的线程数
+    int max_concurrency; // 同时运行的最大会话数，0表示不限制
+    int pool_size;       // 每个服务预先保持的已就绪连接数，0表示不使用连接池
+    bool deflate;        // 是否在握手时请求permessage-deflate，服务器同意后消息压缩传输
 } OTHER{
     text_file : "",
-    audio_file : "speex-wb.spx" // 生成的语音文件保存路径
+    audio_file : "speex-wb.spx", // 生成的语音文件保存路径
+    session_count : 1,
+    thread_count : 1,
+    max_concurrency : 0,
+    pool_size : 0,
+    deflate : false
 };
 
-// tts_client类，继承于iflytek_wssclient
-// 用于与服务器进行websocket(wss)通信
-class tts_client : public iflytek_wssclient
+// tts_session类，继承于iflytek_session
+// 每个对象对应一次与服务器的websocket(wss)会话
+class tts_session : public iflytek_session
 {
 public:
-    tts_client(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER);
+    tts_session(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER);
+    ~tts_session();
 
-protected:
-    // 需要重写如下的iflytek_wssclient的纯虚函数
+    // 需要重写如下的iflytek_session的纯虚函数
     string get_url();
-    void send_data(websocketpp::connection_hdl hdl);
+    int send_data(websocketpp::connection_hdl hdl);
     void on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg);
 
 private:
+    int recv_create();
+    void recv_release();
+
     API_IFNO API;
     COMMON_INFO COMMON;
     BUSINESS_INFO BUSINESS;
     DATA_INFO DATA;
     OTHER_INFO OTHER;
+
+    // json信封模板及发送缓冲区
+    iflytek_envelope envelope;
+    string send_buffer;
+
+    // 接收状态，每条消息的音频数据解码base64后立即写入语音文件并增量解码，不完整的帧由decoder保存到下一条消息
+    iflytek_stream_decoder decoder;
+    FILE *spx_file, *pcm_file;
+    vector<unsigned char> audio;
+
+    // 会话状态
+    int recv_count;
+    string sid;
 };
 
 /***************************************************
  * 主函数部分
  * 
- * 定义tts_client类对象
+ * 定义iflytek_wssclient对象，添加tts_session会话
  * 运行客户端
  ***************************************************
  */
@@ -125,81 +154,132 @@ int main(int argc, char *argv[])
 {
     time_t start_time = clock();
 
-    tts_client client(API, COMMON, BUSINESS, DATA, OTHER);
+    iflytek_wssclient client(OTHER.thread_count, OTHER.max_concurrency);
+    client.set_pool(OTHER.pool_size);
+    iflytek_deflate_options deflate = get_default_deflate_options();
+    deflate.enable = OTHER.deflate;
+    client.set_deflate(deflate);
+    for (int i = 0; i < OTHER.session_count; i++)
+    {
+        // 每个会话的语音文件保存在不同的路径
+        OTHER_INFO other = OTHER;
+        if (OTHER.session_count > 1)
+        {
+            other.audio_file += "." + to_string(i);
+        }
+        client.add_session(websocketpp::lib::make_shared<tts_session>(API, COMMON, BUSINESS, DATA, other));
+    }
     client.run_client();
 
     time_t end_time = clock();
     fprintf(stdout, "[INFO] Time used: %fs\n", (double)(end_time - start_time) / CLOCKS_PER_SEC);
 
-    return 0;
+    return client.get_fail_count() == 0 ? 0 : 1;
 }
 
 /***************************************************
- * tts_client类实现部分
+ * tts_session类实现部分
  * 
- * 实现tts_client类的相关函数
+ * 实现tts_session类的相关函数
  ***************************************************
  */
 /**
  * @brief 构造函数
  * 对语音合成API所涉及参数的初始化
  */
-tts_client::tts_client(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER)
-    : API(API), COMMON(COMMON), BUSINESS(BUSINESS), DATA(DATA), OTHER(OTHER)
+tts_session::tts_session(API_IFNO API, COMMON_INFO COMMON, BUSINESS_INFO BUSINESS, DATA_INFO DATA, OTHER_INFO OTHER)
+    : API(API), COMMON(COMMON), BUSINESS(BUSINESS), DATA(DATA), OTHER(OTHER),
+      spx_file(NULL), pcm_file(NULL), recv_count(0)
 {
+    // 文本在发送时写入，其余字段在会话期间不变
+    json data = {
+        {"common", {{"app_id", this->COMMON.APPID}}},
+        {"business", {{"aue", this->BUSINESS.aue}, {"auf", this->BUSINESS.auf}, {"vcn", this->BUSINESS.vcn}, {"tte", this->BUSINESS.tte}}},
+        {"data", {
+                     {"status", iflytek_envelope::status_placeholder},
+                     {"text", iflytek_envelope::payload_placeholder()},
+                 }}};
+    this->envelope.compile(data);
 }
 
 /**
- * @brief 获得建立连接的鉴权url
- * @return 鉴权url
+ * @brief 析构函数
+ * 释放接收过程中未释放的资源
  */
-string tts_client::get_url()
+tts_session::~tts_session()
 {
-    // 生成RFC1123格式的时间戳，"Thu, 05 Dec 2019 09:54:17 GMT"
-    time_t rawtime = time(NULL);
-    char buf[1024];
-    strftime(buf, sizeof(buf), "%a, %d %b %Y %X %Z", gmtime(&rawtime));
-    string date = string(buf);
-
-    // 拼接signature的原始字符串
-    string signature_origin = "host: tts-api.xfyun.cn\n";
-    signature_origin += "date: " + date + "\n";
-    signature_origin += "GET /v2/tts HTTP/1.1";
-
-    // 使用hmac-sha256算法结合apiSecret对signature_origin签名，获得签名后的摘要signature_sha
-    string signature_sha = get_hmac_sha256(signature_origin, API.APISecret);
+    this->recv_release();
+}
 
-    // 使用base64编码对signature_sha进行编码获得最终的signature
-    string signature = get_base64_encode(signature_sha);
+/**
+ * @brief 创建语音文件及解码器
+ * 解码得到的pcm数据由回调函数直接写入"audio_file.out.pcm"
+ * @return 成功时返回0，失败时返回-1
+ */
+int tts_session::recv_create()
+{
+    this->spx_file = fopen(this->OTHER.audio_file.c_str(), "wb");
+    this->pcm_file = fopen((this->OTHER.audio_file + ".out.pcm").c_str(), "wb");
+    if (this->spx_file == NULL || this->pcm_file == NULL)
+    {
+        fprintf(stderr, "\n[ERROR] Session %d: Failed to open the file \"%s\"\n", this->id, this->OTHER.audio_file.c_str());
+        return -1;
+    }
 
-    // 拼接authorization的原始字符串
-    sprintf(buf, "api_key=\"%s\", algorithm=\"%s\", headers=\"%s\", signature=\"%s\"",
-            API.APIKey.c_str(), "hmac-sha256", "host date request-line", signature.c_str());
-    string authorization_origin = string(buf);
+    FILE *pcm_file = this->pcm_file;
+    return this->decoder.create(this->BUSINESS.aue, [pcm_file](const unsigned char *pcm, int pcm_length) {
+        fwrite(pcm, sizeof(char), pcm_length, pcm_file);
+    }) == -1 ? -1 : 0;
+}
 
-    // 再对authorization_origin进行base64编码获得最终的authorization参数
-    string authorization = get_base64_encode(authorization_origin);
+/**
+ * @brief 释放解码器及语音文件
+ */
+void tts_session::recv_release()
+{
+    this->decoder.destroy();
+    if (this->spx_file != NULL)
+    {
+        fclose(this->spx_file);
+        this->spx_file = NULL;
+    }
+    if (this->pcm_file != NULL)
+    {
+        fclose(this->pcm_file);
+        this->pcm_file = NULL;
+    }
+}
 
-    // 对相关参数构成url，并进行url编码，生成最终鉴权url
-    sprintf(buf, "authorization=%s&date=%s&host=%s",
-            authorization.c_str(), date.c_str(), "tts-api.xfyun.cn");
-    string url = "wss://tts-api.xfyun.cn/v2/tts?" + get_url_encode(string(buf));
+/**
+ * @brief 获得建立连接的鉴权url
+ * @return 鉴权url
+ */
+string tts_session::get_url()
+{
+    // 所有会话共享同一个鉴权url生成器，hmac的内外填充状态在第一次调用时按APISecret计算一次
+    static iflytek_authorizer authorizer("tts-api.xfyun.cn", "/v2/tts", this->API.APIKey, this->API.APISecret);
 
-    return url;
+    // 生成带RFC1123格式时间戳（例如"Thu, 05 Dec 2019 09:54:17 GMT"）的鉴权url
+    char url[1024];
+    size_t length = authorizer.get_url(url, sizeof(url));
+    return string(url, length);
 }
 
 /**
  * @brief 向服务器发送数据
+ * 流式合成的文本只能一次性传输，只需要发送一帧数据
  * @param hdl 当前连接的句柄
+ * @return 发送结束，始终返回-1
  */
-void tts_client::send_data(websocketpp::connection_hdl hdl)
+int tts_session::send_data(websocketpp::connection_hdl hdl)
 {
-    fprintf(stdout, "[INFO] Sending text data to server...\n");
+    fprintf(stdout, "[INFO] Session %d: Sending text data to server...\n", this->id);
 
     if (this->DATA.text == "" && this->OTHER.text_file == "")
     {
-        fprintf(stderr, "[ERROR] Provide at least one, between \"DATA.text\" and \"OTHER.text_file\"\n");
-        exit(1);
+        fprintf(stderr, "[ERROR] Session %d: Provide at least one, between \"DATA.text\" and \"OTHER.text_file\"\n", this->id);
+        this->close(hdl, "text error");
+        return -1;
     }
     else if (this->OTHER.text_file != "")
     {
@@ -207,8 +287,9 @@ void tts_client::send_data(websocketpp::connection_hdl hdl)
         if (fin == NULL)
         {
             // 文件打开错误
-            fprintf(stderr, "[ERROR] Failed to open the file \"%s\"\n", this->OTHER.text_file.c_str());
-            exit(1);
+            fprintf(stderr, "[ERROR] Session %d: Failed to open the file \"%s\"\n", this->id, this->OTHER.text_file.c_str());
+            this->close(hdl, "file error");
+            return -1;
         }
         fseek(fin, 0, SEEK_END);
         int size = ftell(fin);
@@ -222,17 +303,18 @@ void tts_client::send_data(websocketpp::connection_hdl hdl)
         delete[] text;
     }
 
-    json data = {
-        {"common", {{"app_id", this->COMMON.APPID}}},
-        {"business", {{"aue", this->BUSINESS.aue}, {"auf", this->BUSINESS.auf}, {"vcn", this->BUSINESS.vcn}, {"tte", this->BUSINESS.tte}}},
-        {"data", {
-                     {"status", 2},
-                     {"text", get_base64_encode(this->DATA.text)},
-                 }}};
+    this->envelope.serialize(2, (const unsigned char *)this->DATA.text.data(), this->DATA.text.size(), this->send_buffer);
 
-    this->wssclient.send(hdl, data.dump(), websocketpp::frame::opcode::text);
+    websocketpp::lib::error_code ec;
+    this->wssclient->send(hdl, this->send_buffer.data(), this->send_buffer.size(), websocketpp::frame::opcode::text, ec);
+    if (ec)
+    {
+        fprintf(stderr, "[ERROR] Session %d: Failed to send data: \"%s\"\n", this->id, ec.message().c_str());
+        return -1;
+    }
 
-    fprintf(stdout, "[SUCCESS] No.1 frame sent，OVER\n"); // 只需要发送一帧数据
+    fprintf(stdout, "[SUCCESS] Session %d: No.1 frame sent，OVER\n", this->id); // 只需要发送一帧数据
+    return -1;
 }
 
 /**
@@ -240,117 +322,64 @@ void tts_client::send_data(websocketpp::connection_hdl hdl)
  * @param hdl 当前连接的句柄
  * @param msg 服务器数据的句柄
  */
-void tts_client::on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg)
+void tts_session::on_message(websocketpp::connection_hdl hdl, asio_tls_client::message_ptr msg)
 {
-    static int cnt = 0;
-    // 判断保存音频文件是否存在，存在则删除之
-    if (cnt == 0)
+    // 收到第一条消息时创建语音文件及解码器
+    if (this->recv_count == 0 && this->recv_create() == -1)
     {
-        if (FILE *file = fopen(this->OTHER.audio_file.c_str(), "r"))
-        {
-            fclose(file);
-            remove(this->OTHER.audio_file.c_str());
-        }
-        if (FILE *file = fopen((this->OTHER.audio_file + ".out.pcm").c_str(), "r"))
-        {
-            fclose(file);
-            remove(this->OTHER.audio_file.c_str());
-        }
+        this->recv_release();
+        this->close(hdl, "decoder error");
+        return;
     }
-    fprintf(stdout, "\r[INFO] WebSocket's STATE is ON_MESSAGE, No.%d frame received", ++cnt);
+    fprintf(stdout, "\r[INFO] Session %d: WebSocket's STATE is ON_MESSAGE, No.%d frame received", this->id, ++this->recv_count);
     fflush(stdout);
 
     json recv_data = json::parse(msg->get_payload());
-    static string sid = recv_data["sid"];
+    if (this->sid.empty() && recv_data["sid"].is_string())
+    {
+        this->sid = recv_data["sid"];
+    }
     int code = recv_data["code"];
 
     // 拼接结果
     if (code == 0)
     {
-        json result = recv_data["data"];
+        json &result = recv_data["data"];
 
-        // 保存原始speex数据
-        FILE *fout = fopen(this->OTHER.audio_file.c_str(), "ab");
-        string temp = get_base64_decode(result["audio"]);
-        fwrite(temp.c_str(), sizeof(char), temp.size(), fout);
-        fclose(fout);
+        // 保存原始音频数据，并解码其中所有完整的帧
+        const string &audio = result["audio"].get_ref<const string &>();
+        this->audio.resize(get_base64_decode_length(audio.size()));
+        long audio_length = get_base64_decode(audio.data(), audio.size(), this->audio.data());
+        if (audio_length == -1 || this->decoder.decode(this->audio.data(), audio_length) == -1)
+        {
+            this->recv_release();
+            this->close(hdl, "decoder error");
+            return;
+        }
+        fwrite(this->audio.data(), sizeof(char), audio_length, this->spx_file);
 
         if (result["status"] == 2)
         {
-            iflytek_codec *codec = new speex_codec;
-            int pcm_length = codec->decode_create(this->BUSINESS.aue);
-            if (pcm_length == -1)
+            if (this->decoder.get_pending_length() != 0)
             {
-                delete codec;
-                exit(1);
+                fprintf(stderr, "\n[INFO] Session %d: %d bytes of a truncated last frame discarded\n", this->id, (int)this->decoder.get_pending_length());
             }
-
-            // 将保存好的speex数据解码成pcm数据
-            FILE *fin = fopen(this->OTHER.audio_file.c_str(), "rb");
-            FILE *fout = fopen((this->OTHER.audio_file + ".out.pcm").c_str(), "wb");
-
-            unsigned char *head = new unsigned char;
-            unsigned char *speex = new unsigned char[pcm_length];
-            unsigned char *pcm = new unsigned char[pcm_length];
-
-            // 开始解码
-            while (1)
-            {
-                // 读取1字节头部
-                fread(head, sizeof(char), 1, fin);
-                // short *length = (short *)head;
-                // *length = (*length << 8) | (*length >> 8);
-                // int speex_length = int(*length);
-                int speex_length = int(*head);
-                if ((speex_length = fread(speex, sizeof(char), speex_length, fin)) == 0)
-                {
-                    break;
-                }
-
-                if ((pcm_length = codec->decode(speex, speex_length, pcm)) == -1)
-                {
-                    codec->decode_destroy();
-                    delete codec;
-                    delete head;
-                    delete[] speex;
-                    delete[] pcm;
-                    fclose(fin);
-                    fclose(fout);
-                    exit(1);
-                }
-                fwrite(pcm, sizeof(char), pcm_length, fout);
-            }
-
-            codec->decode_destroy();
-            delete codec;
-            delete head;
-            delete[] speex;
-            delete[] pcm;
-            fclose(fin);
-            fclose(fout);
+            this->recv_release();
 
             // 客户端主动关闭连接
-            asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl);
-            if (con != NULL && con->get_state() == websocketpp::session::state::value::open)
-            {
-                con->close(0, "receive over");
-            }
+            this->success = true;
+            this->close(hdl, "receive over");
 
             // 输出最终结果
-            fprintf(stdout, "\n[SUCCESS] sid: \"%s\" call success. The original file (.spx) is saved in \"%s\", and the decoded file (.pcm) is saved in \"%s.out.pcm\"\n",
-                    sid.c_str(), this->OTHER.audio_file.c_str(), this->OTHER.audio_file.c_str());
+            fprintf(stdout, "\n[SUCCESS] Session %d: sid: \"%s\" call success. The original file (.spx) is saved in \"%s\", and the decoded file (.pcm) is saved in \"%s.out.pcm\"\n",
+                    this->id, this->sid.c_str(), this->OTHER.audio_file.c_str(), this->OTHER.audio_file.c_str());
         }
     }
     else
     {
         // 客户端主动关闭连接
-        asio_tls_client::connection_ptr con = this->wssclient.get_con_from_hdl(hdl);
-        if (con != NULL && con->get_state() == websocketpp::session::state::value::open)
-        {
-            con->close(0, "receive over");
-        }
+        this->close(hdl, "receive over");
 
-        cout << "\n[ERROR] sid: \"" << sid << "\" call error. ERROR_CODE: \"" << code << "\", ERROR_MSG: " << recv_data["message"] << endl;
-        exit(1);
+        cout << "\n[ERROR] Session " << this->id << ": sid: \"" << this->sid << "\" call error. ERROR_CODE: \"" << code << "\", ERROR_MSG: " << recv_data["message"] << endl;
     }
 }
\ No newline at end of file